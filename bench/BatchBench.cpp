@@ -0,0 +1,85 @@
+// Requests and notifications per second in batches of 1, 8 and 64, with
+// batching off and negotiated, against StandInServer (which selects
+// protoo-batch when offered).
+//
+//   BatchBench [messages per size=32000] [url=wss://localhost:9443/]
+//
+// Each requestBatch waits for all its responses before the next; the
+// notifications are timed up to the response of one request sent after them.
+#include "Peer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace protoo;
+
+namespace
+{
+	double since(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void run(const std::string& url, BatchMode mode, int messages)
+	{
+		std::unique_ptr<WebSocketTransport> transport(new WebSocketTransport(url, nullptr));
+		transport->set_batch_mode(mode);
+		WebSocketTransport* raw = transport.get();
+		Peer peer(std::move(transport));
+		std::promise<void> opened;
+		peer.set_open_handler([&]() { opened.set_value(); });
+		if (opened.get_future().wait_for(std::chrono::seconds(10)) != std::future_status::ready)
+		{
+			std::printf("could not connect to %s\n", url.c_str());
+			return;
+		}
+
+		std::printf("batching %s\n", raw->batching() ? "on" : "off");
+		for (int size : { 1, 8, 64 })
+		{
+			std::vector<std::pair<std::string, json>> requests;
+			std::vector<std::pair<std::string, json>> notifications;
+			for (int i = 0; i < size; ++i)
+			{
+				requests.emplace_back("echo", json{ { "i", i }, { "name", "consumer" } });
+				notifications.emplace_back("tick", json{ { "i", i } });
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			for (int sent = 0; sent < messages; sent += size)
+			{
+				for (auto& response : peer.requestBatch(requests))
+					response.get();
+			}
+			double requestSecs = since(start);
+
+			start = std::chrono::steady_clock::now();
+			for (int sent = 0; sent < messages; sent += size)
+				peer.notifyMany(notifications);
+			peer.request("fence", json::object());
+			double notifySecs = since(start);
+
+			std::printf("  batch %2d: %6.0f requests/s, %6.0f notifications/s\n",
+				size, messages / requestSecs, messages / notifySecs);
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int messages = argc > 1 ? std::atoi(argv[1]) : 32000;
+	const std::string url = argc > 2 ? argv[2] : "wss://localhost:9443/";
+	// the transport logs every connection to std::cout
+	std::cout.setstate(std::ios::failbit);
+
+	run(url, BatchMode::off, messages);
+	run(url, BatchMode::negotiate, messages);
+	return 0;
+}
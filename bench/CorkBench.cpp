@@ -0,0 +1,108 @@
+// Write syscalls and TLS records per notification, uncorked and corked,
+// against StandInServer.
+//
+//   CorkBench [messages=20000] [interval us=0] [url=wss://localhost:9443/]
+//
+// Writes are the send() and sendmsg() calls asio makes, counted by wrapping
+// both in this program, so the server must run in a process of its own.
+// Records are the ones the server read, which it reports through its
+// "stats" request; that request also waits for every notification before it
+// to arrive. The notifications go back to back (interval 0) or one every
+// interval.
+#include "Peer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <dlfcn.h>
+#include <sys/socket.h>
+
+using namespace protoo;
+
+namespace
+{
+	std::atomic<uint64_t> writes{ 0 };
+
+	uint64_t records(Peer& peer)
+	{
+		return peer.request("stats", json::object())["records"].get<uint64_t>();
+	}
+
+	void run(const std::string& url, const char* name, std::chrono::microseconds window, int messages, int interval)
+	{
+		std::unique_ptr<WebSocketTransport> transport(new WebSocketTransport(url, nullptr));
+		cork_options cork;
+		cork.window = window;
+		cork.auto_tune = false;
+		transport->set_cork(cork);
+		Peer peer(std::move(transport));
+		std::promise<void> opened;
+		peer.set_open_handler([&]() { opened.set_value(); });
+		if (opened.get_future().wait_for(std::chrono::seconds(10)) != std::future_status::ready)
+		{
+			std::printf("could not connect to %s\n", url.c_str());
+			return;
+		}
+
+		uint64_t recordsBefore = records(peer);
+		uint64_t writesBefore = writes;
+		auto start = std::chrono::steady_clock::now();
+		auto next = start;
+		for (int i = 0; i < messages; ++i)
+		{
+			if (interval)
+			{
+				next += std::chrono::microseconds(interval);
+				std::this_thread::sleep_until(next);
+			}
+			peer.notify("tick", { { "i", i }, { "name", "consumer" } });
+		}
+		// the stats request and its own record are one more each
+		uint64_t recordsSent = records(peer) - recordsBefore - 1;
+		uint64_t writesSent = writes - writesBefore - 1;
+		double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::printf("  %-14s %.3f writes, %.3f TLS records per message, %7.0f messages/s\n",
+			name, double(writesSent) / messages, double(recordsSent) / messages, messages / secs);
+	}
+}
+
+extern "C" ssize_t send(int fd, const void* buf, size_t size, int flags)
+{
+	typedef ssize_t (*send_t)(int, const void*, size_t, int);
+	static send_t next = reinterpret_cast<send_t>(dlsym(RTLD_NEXT, "send"));
+	++writes;
+	return next(fd, buf, size, flags);
+}
+
+extern "C" ssize_t sendmsg(int fd, const struct msghdr* msg, int flags)
+{
+	typedef ssize_t (*sendmsg_t)(int, const struct msghdr*, int);
+	static sendmsg_t next = reinterpret_cast<sendmsg_t>(dlsym(RTLD_NEXT, "sendmsg"));
+	++writes;
+	return next(fd, msg, flags);
+}
+
+int main(int argc, char* argv[])
+{
+	const int messages = argc > 1 ? std::atoi(argv[1]) : 20000;
+	const int interval = argc > 2 ? std::atoi(argv[2]) : 0;
+	const std::string url = argc > 3 ? argv[3] : "wss://localhost:9443/";
+	// the transport logs every connection to std::cout
+	std::cout.setstate(std::ios::failbit);
+
+	std::printf("%d notifications, %s\n", messages,
+		interval ? ("one every " + std::to_string(interval) + " us").c_str() : "back to back");
+	run(url, "uncorked", std::chrono::microseconds(0), messages, interval);
+	run(url, "corked 200 us", std::chrono::microseconds(200), messages, interval);
+	run(url, "corked 2 ms", std::chrono::milliseconds(2), messages, interval);
+	return 0;
+}
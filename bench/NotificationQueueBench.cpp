@@ -0,0 +1,136 @@
+// Notification latency from push on the transport side to pop on the
+// notification thread: NotificationQueue against the old path, a std::list
+// under a mutex with a condition_variable notified on every push.
+//
+//   NotificationQueueBench [messages=200000] [producers=1] [interval us=20]
+//
+// Each producer pushes its share of the messages, one every interval (0
+// pushes back to back, which measures the backlog rather than the wake-up).
+// The consumer touches every message as a handler would.
+#include "NotificationQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace protoo;
+using nlohmann::json;
+
+namespace
+{
+	typedef std::chrono::steady_clock clock;
+
+	// onMessage() and handleNotification() before NotificationQueue
+	class LockedQueue
+	{
+	public:
+		void push(json&& message)
+		{
+			mtx_.lock();
+			messages_.push_back(message);
+			mtx_.unlock();
+			cond_.notify_one();
+		}
+
+		bool pop(json& message)
+		{
+			std::unique_lock<std::mutex> lk(mtx_);
+			while (messages_.empty())
+			{
+				if (closed_)
+					return false;
+				cond_.wait(lk);
+			}
+			message = *messages_.begin();
+			messages_.pop_front();
+			return true;
+		}
+
+		void close()
+		{
+			{
+				std::lock_guard<std::mutex> lk(mtx_);
+				closed_ = true;
+			}
+			cond_.notify_all();
+		}
+
+	private:
+		std::list<json> messages_;
+		std::mutex mtx_;
+		std::condition_variable cond_;
+		bool closed_{ false };
+	};
+
+	int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+	}
+
+	template<typename Queue>
+	void run(const char* name, Queue& queue, int messages, int producers, int interval)
+	{
+		std::vector<double> latency;
+		latency.reserve(messages);
+		std::thread consumer([&]() {
+			json message;
+			while (queue.pop(message))
+				latency.push_back((now() - message["data"]["sent"].get<int64_t>()) / 1000.0);
+		});
+
+		auto start = clock::now();
+		std::vector<std::thread> threads;
+		for (int p = 0; p < producers; ++p)
+		{
+			threads.emplace_back([&, p]() {
+				auto next = clock::now();
+				for (int i = p; i < messages; i += producers)
+				{
+					if (interval)
+					{
+						next += std::chrono::microseconds(interval);
+						std::this_thread::sleep_until(next);
+					}
+					queue.push({ { "notification", true }, { "method", "tick" },
+						{ "data", { { "i", i }, { "sent", now() } } } });
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		queue.close();
+		consumer.join();
+		double secs = std::chrono::duration<double>(clock::now() - start).count();
+
+		std::sort(latency.begin(), latency.end());
+		size_t n = latency.size();
+		std::printf("  %-28s p50 %7.1f us, p99 %8.1f us, max %9.1f us, %7.0f msg/s\n",
+			name, latency[n / 2], latency[n * 99 / 100], latency[n - 1], n / secs);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int messages = argc > 1 ? std::atoi(argv[1]) : 200000;
+	const int producers = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 1;
+	const int interval = argc > 3 ? std::atoi(argv[3]) : 20;
+
+	std::printf("%d messages from %d producers, one every %d us each, %u hardware threads\n",
+		messages, producers, interval, std::thread::hardware_concurrency());
+	{
+		NotificationQueue queue;
+		run("NotificationQueue", queue, messages, producers, interval);
+	}
+	{
+		LockedQueue queue;
+		run("list + mutex + condition", queue, messages, producers, interval);
+	}
+	return 0;
+}
@@ -0,0 +1,110 @@
+// Connections per second and memory per idle peer with PeerManager, against
+// a local server such as StandInServer. With 0 io threads every peer gets
+// its own threads instead, as before PeerManager.
+//
+//   PeerManagerBench [peers=1000] [io threads=1] [url=wss://localhost:9443/]
+//
+// Memory and thread counts are read from /proc/self/status (Linux only).
+#include "PeerManager.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace protoo;
+
+namespace
+{
+	long status(const char* field)
+	{
+		std::ifstream file("/proc/self/status");
+		std::string line;
+		size_t length = std::strlen(field);
+		while (std::getline(file, line))
+		{
+			if (line.compare(0, length, field) == 0)
+				return std::atol(line.c_str() + length);
+		}
+		return 0;
+	}
+
+	double since(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	template<typename F>
+	bool waitFor(F&& done, int seconds)
+	{
+		auto start = std::chrono::steady_clock::now();
+		while (!done())
+		{
+			if (since(start) > seconds)
+				return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int count = argc > 1 ? std::atoi(argv[1]) : 1000;
+	const size_t threads = argc > 2 ? std::atoi(argv[2]) : 1;
+	const std::string url = argc > 3 ? argv[3] : "wss://localhost:9443/";
+	// the transport logs every connection to std::cout
+	std::cout.setstate(std::ios::failbit);
+
+	std::unique_ptr<PeerManager> manager;
+	if (threads)
+	{
+		peer_manager_options options;
+		options.threads = threads;
+		options.assignment = PeerAssignment::least_loaded;
+		manager.reset(new PeerManager(options));
+	}
+
+	long rssBefore = status("VmRSS:");
+	std::atomic<int> opened{ 0 };
+	std::vector<std::shared_ptr<Peer>> peers;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; ++i)
+	{
+		if (manager)
+		{
+			peers.push_back(manager->create(url, [&](Peer& peer) { peer.set_open_handler([&]() { ++opened; }); }));
+		}
+		else
+		{
+			auto peer = std::make_shared<Peer>(std::unique_ptr<WebSocketTransport>(new WebSocketTransport(url, nullptr)));
+			peer->set_open_handler([&]() { ++opened; });
+			peers.push_back(peer);
+		}
+	}
+	waitFor([&]() { return opened == count; }, 120);
+	double connectSecs = since(start);
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	long rss = status("VmRSS:") - rssBefore;
+
+	std::printf("%d peers, %s\n", count, threads ? (std::to_string(threads) + " io threads").c_str() : "own threads per peer");
+	std::printf("  opened %d in %.2f s, %.0f conn/s\n", opened.load(), connectSecs, opened / connectSecs);
+	std::printf("  %.1f KiB RSS per idle peer, %ld threads\n", double(rss) / count, status("Threads:"));
+
+	std::atomic<int> answered{ 0 };
+	start = std::chrono::steady_clock::now();
+	for (auto& peer : peers)
+		peer->requestAsync("echo", { { "x", 1 } }, [&](const json&, std::exception_ptr) { ++answered; });
+	waitFor([&]() { return answered == count; }, 60);
+	std::printf("  one echo request on every peer: %.1f ms\n", since(start) * 1000);
+
+	peers.clear();
+	return opened == count && answered == count ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+// Request-id allocation and lookup under contention: N threads each keep a
+// window of requests in flight, registering one (request) and resolving
+// the oldest (handleResponse) per step. Compares SlotTable with the old
+// scheme, a random 16-bit id from std::random_device checked against a
+// std::map under one mutex. Then the same threads share one Peer and keep
+// their window of requestAsync calls in flight against StandInServer, one
+// request for every 50 steps.
+//
+//   RequestIdBench [steps per thread=500000] [in flight per thread=16]
+//       [url=wss://localhost:9443/] [threads...]
+//
+// Thread counts default to 1, 2, 4 and 8. Contention only shows when the
+// machine has that many cores. The Peer part is skipped if url does not
+// connect.
+#include "Peer.h"
+#include "SlotTable.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace protoo;
+
+namespace
+{
+	// roughly what Peer keeps per request
+	typedef struct
+	{
+		std::function<void(void)> handler;
+		uint64_t timer;
+	}sent_t;
+
+	template<typename F>
+	double run(int threads, F&& body)
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; ++t)
+			workers.emplace_back(body);
+		for (auto& worker : workers)
+			worker.join();
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int steps = argc > 1 ? std::atoi(argv[1]) : 500000;
+	const size_t window = argc > 2 ? std::atoi(argv[2]) : 16;
+	const std::string url = argc > 3 ? argv[3] : "wss://localhost:9443/";
+	std::vector<int> counts;
+	for (int i = 4; i < argc; ++i)
+		counts.push_back(std::atoi(argv[i]));
+	if (counts.empty())
+		counts = { 1, 2, 4, 8 };
+
+	std::printf("%u hardware threads, %zu requests in flight per thread\n", std::thread::hardware_concurrency(), window);
+	for (int threads : counts)
+	{
+		SlotTable<sent_t> table;
+		double slots = run(threads, [&]() {
+			std::deque<int> inflight;
+			sent_t sent;
+			for (int i = 0; i < steps; ++i)
+			{
+				inflight.push_back(table.emplace([](int, sent_t& s) { s.timer = 1; }));
+				if (inflight.size() > window)
+				{
+					table.take(inflight.front(), sent);
+					inflight.pop_front();
+				}
+			}
+			for (int id : inflight)
+				table.take(id, sent);
+		});
+
+		std::map<int, sent_t> sents;
+		std::mutex mtx;
+		std::random_device device;
+		double locked = run(threads, [&]() {
+			std::deque<int> inflight;
+			std::uniform_int_distribution<uint16_t> random;
+			for (int i = 0; i < steps; ++i)
+			{
+				{
+					std::lock_guard<std::mutex> lk(mtx);
+					int id;
+					do
+					{
+						id = random(device);
+					} while (sents.count(id));
+					sents[id].timer = 1;
+					inflight.push_back(id);
+				}
+				if (inflight.size() > window)
+				{
+					std::lock_guard<std::mutex> lk(mtx);
+					sents.erase(inflight.front());
+					inflight.pop_front();
+				}
+			}
+			std::lock_guard<std::mutex> lk(mtx);
+			for (int id : inflight)
+				sents.erase(id);
+		});
+
+		double ops = double(steps) * threads;
+		std::printf("%2d threads: slot table %4.0f ns, random_device + map + mutex %4.0f ns per request\n",
+			threads, slots / ops, locked / ops);
+	}
+
+	// the transport logs every connection to std::cout
+	std::cout.setstate(std::ios::failbit);
+	Peer peer(std::unique_ptr<WebSocketTransport>(new WebSocketTransport(url, nullptr)));
+	std::promise<void> opened;
+	peer.set_open_handler([&]() { opened.set_value(); });
+	if (opened.get_future().wait_for(std::chrono::seconds(10)) != std::future_status::ready)
+	{
+		std::printf("could not connect to %s, skipping requestAsync\n", url.c_str());
+		return 0;
+	}
+
+	const int requests = std::max(steps / 50, 1);
+	for (int threads : counts)
+	{
+		double elapsed = run(threads, [&]() {
+			std::mutex mtx;
+			std::condition_variable cond;
+			size_t inflight = 0;
+			for (int i = 0; i < requests; ++i)
+			{
+				{
+					std::unique_lock<std::mutex> lk(mtx);
+					cond.wait(lk, [&]() { return inflight < window; });
+					++inflight;
+				}
+				peer.requestAsync("echo", { { "i", i } }, [&](const json&, std::exception_ptr) {
+					std::lock_guard<std::mutex> lk(mtx);
+					--inflight;
+					cond.notify_one();
+				});
+			}
+			std::unique_lock<std::mutex> lk(mtx);
+			cond.wait(lk, [&]() { return inflight == 0; });
+		});
+
+		double total = double(requests) * threads;
+		std::printf("%2d threads: requestAsync %6.1f us per request, %7.0f requests/s\n",
+			threads, elapsed / total / 1000, total / (elapsed / 1e9));
+	}
+	return 0;
+}
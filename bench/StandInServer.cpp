@@ -0,0 +1,23 @@
+// Runs StandInServer (see StandInServer.h) for the benchmarks to connect to.
+//
+//   StandInServer [port=9443]
+#include <cstdio>
+#include <cstdlib>
+
+#include "StandInServer.h"
+
+int main(int argc, char* argv[])
+{
+	const uint16_t port = uint16_t(argc > 1 ? std::atoi(argv[1]) : 9443);
+
+	protoo::StandInServer server;
+	if (!server.listen(port))
+	{
+		std::fprintf(stderr, "listen on %u failed\n", port);
+		return 1;
+	}
+	std::printf("listening on wss://localhost:%u/\n", port);
+	std::fflush(stdout);
+	server.run();
+	return 0;
+}
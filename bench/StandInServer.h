@@ -0,0 +1,195 @@
+#ifndef CHAI51_BENCH_STAND_IN_SERVER
+#define CHAI51_BENCH_STAND_IN_SERVER
+
+// Local stand-in for a protoo server, for the benchmarks and tests that need
+// one. Answers every request with ok and the request's data, and sends
+// notifications of method "echo" back. Selects the protoo-batch subprotocol
+// when offered and answers a batch with a batch. TLS uses a self-signed
+// certificate made at construction; the transport does not verify it.
+// A request of method "stats" is answered with the number of TLS records
+// received so far, over all connections.
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <websocketpp/config/asio.hpp>
+#include <websocketpp/server.hpp>
+
+#include "json.hpp"
+
+namespace protoo
+{
+	class StandInServer
+	{
+	public:
+		typedef websocketpp::server<websocketpp::config::asio_tls> server;
+
+		StandInServer()
+		{
+			makeIdentity();
+
+			server_.clear_access_channels(websocketpp::log::alevel::all);
+			server_.clear_error_channels(websocketpp::log::elevel::all);
+			server_.init_asio();
+			server_.set_reuse_addr(true);
+			server_.set_listen_backlog(1024);
+
+			server_.set_tls_init_handler([this](websocketpp::connection_hdl) {
+				auto ctx = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls);
+				SSL_CTX_use_certificate(ctx->native_handle(), cert_.get());
+				SSL_CTX_use_PrivateKey(ctx->native_handle(), key_.get());
+				SSL_CTX_set_msg_callback(ctx->native_handle(), &StandInServer::onProtocolMessage);
+				SSL_CTX_set_msg_callback_arg(ctx->native_handle(), this);
+				return ctx;
+			});
+			server_.set_tcp_post_init_handler([this](websocketpp::connection_hdl hdl) {
+				boost::system::error_code ec;
+				server_.get_con_from_hdl(hdl)->get_raw_socket().set_option(boost::asio::ip::tcp::no_delay(true), ec);
+			});
+			server_.set_validate_handler([this](websocketpp::connection_hdl hdl) {
+				server::connection_ptr con = server_.get_con_from_hdl(hdl);
+				std::string selected;
+				for (const auto& protocol : con->get_requested_subprotocols())
+				{
+					if (protocol == "protoo-batch" || (protocol == "protoo" && selected.empty()))
+						selected = protocol;
+				}
+				if (!selected.empty())
+					con->select_subprotocol(selected);
+				return true;
+			});
+			server_.set_message_handler([this](websocketpp::connection_hdl hdl, server::message_ptr msg) {
+				onMessage(hdl, msg);
+			});
+		}
+
+		~StandInServer()
+		{
+			stop();
+		}
+
+		// 0 picks a free port. Returns the port, or 0 if listening failed.
+		uint16_t listen(uint16_t port)
+		{
+			websocketpp::lib::error_code ec;
+			server_.listen(port, ec);
+			if (ec)
+				return 0;
+			server_.start_accept(ec);
+			if (ec)
+				return 0;
+			boost::system::error_code local;
+			return server_.get_local_endpoint(local).port();
+		}
+
+		// serves on the calling thread until stop()
+		void run()
+		{
+			server_.run();
+		}
+
+		// serves on a thread of its own until stop()
+		void start()
+		{
+			thread_.reset(new std::thread([this]() { server_.run(); }));
+		}
+
+		void stop()
+		{
+			if (!thread_)
+				return;
+			server_.stop();
+			thread_->join();
+			thread_.reset();
+		}
+
+		uint64_t records_received() const { return records_; }
+
+	private:
+		void makeIdentity()
+		{
+			EVP_PKEY* key = nullptr;
+			std::shared_ptr<EVP_PKEY_CTX> kctx(EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr), EVP_PKEY_CTX_free);
+			if (!kctx || EVP_PKEY_keygen_init(kctx.get()) <= 0 || EVP_PKEY_CTX_set_rsa_keygen_bits(kctx.get(), 2048) <= 0 ||
+				EVP_PKEY_keygen(kctx.get(), &key) <= 0)
+				throw std::runtime_error("key generation failed");
+			key_.reset(key, EVP_PKEY_free);
+			cert_.reset(X509_new(), X509_free);
+
+			X509* cert = cert_.get();
+			ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+			X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+			X509_gmtime_adj(X509_getm_notAfter(cert), 365 * 24 * 3600L);
+			X509_set_pubkey(cert, key);
+			X509_NAME* name = X509_get_subject_name(cert);
+			X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+			X509_set_issuer_name(cert, name);
+			if (!X509_sign(cert, key, EVP_sha256()))
+				throw std::runtime_error("certificate signing failed");
+		}
+
+		// counts the headers of records read, handshake ones included
+		static void onProtocolMessage(int write, int, int type, const void*, size_t, SSL*, void* arg)
+		{
+			if (!write && type == SSL3_RT_HEADER)
+				++static_cast<StandInServer*>(arg)->records_;
+		}
+
+		// null if the message needs no answer
+		nlohmann::json answerTo(nlohmann::json& message) const
+		{
+			if (!message.is_object())
+				return nullptr;
+			if (message.value("request", false) && message["method"] == "stats")
+				return { { "response", true }, { "id", message["id"] }, { "ok", true }, { "data", { { "records", records_.load() } } } };
+			if (message.value("request", false))
+				return { { "response", true }, { "id", message["id"] }, { "ok", true }, { "data", message["data"] } };
+			if (message.value("notification", false) && message["method"] == "echo")
+				return std::move(message);
+			return nullptr;
+		}
+
+		void onMessage(websocketpp::connection_hdl hdl, server::message_ptr msg)
+		{
+			nlohmann::json message = nlohmann::json::parse(msg->get_payload(), nullptr, false);
+			nlohmann::json reply;
+			if (message.is_array())
+			{
+				reply = nlohmann::json::array();
+				for (auto& element : message)
+				{
+					nlohmann::json answer = answerTo(element);
+					if (!answer.is_null())
+						reply.push_back(std::move(answer));
+				}
+				if (reply.empty())
+					return;
+			}
+			else
+			{
+				reply = answerTo(message);
+				if (reply.is_null())
+					return;
+			}
+
+			websocketpp::lib::error_code ec;
+			server_.send(hdl, reply.dump(), websocketpp::frame::opcode::text, ec);
+		}
+
+	private:
+		server server_;
+		std::shared_ptr<EVP_PKEY> key_;
+		std::shared_ptr<X509> cert_;
+		std::unique_ptr<std::thread> thread_;
+		std::atomic<uint64_t> records_{ 0 };
+	};
+}
+
+#endif	// CHAI51_BENCH_STAND_IN_SERVER
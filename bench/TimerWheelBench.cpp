@@ -0,0 +1,77 @@
+// TimerWheel with many pending request timeouts: cost to arm and cancel,
+// how late timers fire, and the CPU the wheel spends while they wait.
+//
+//   TimerWheelBench [timers=100000] [max timeout ms=2500]
+//
+// Timeouts are spread evenly from 500 ms to the maximum. Build with
+// CMAKE_BUILD_TYPE=Release for meaningful numbers.
+#include "TimerWheel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <thread>
+#include <vector>
+
+using protoo::TimerWheel;
+
+namespace
+{
+	double since(TimerWheel::clock::time_point start)
+	{
+		return std::chrono::duration<double, std::nano>(TimerWheel::clock::now() - start).count();
+	}
+
+	double cpuMs()
+	{
+		return 1000.0 * std::clock() / CLOCKS_PER_SEC;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int timers = argc > 1 ? std::atoi(argv[1]) : 100000;
+	const int maxMs = argc > 2 ? std::max(std::atoi(argv[2]), 501) : 2500;
+
+	TimerWheel wheel;
+	std::mt19937 rng(1);
+
+	// what a request that gets its response in time costs
+	std::vector<TimerWheel::timer_id> ids(timers);
+	auto start = TimerWheel::clock::now();
+	for (int i = 0; i < timers; ++i)
+		ids[i] = wheel.schedule(std::chrono::milliseconds(500 + rng() % (maxMs - 500)), []() {});
+	double armNs = since(start) / timers;
+	start = TimerWheel::clock::now();
+	for (auto id : ids)
+		wheel.cancel(id);
+	double cancelNs = since(start) / timers;
+
+	// and one that times out
+	std::vector<double> late(timers);
+	std::atomic<int> fired{ 0 };
+	for (int i = 0; i < timers; ++i)
+	{
+		auto timeout = std::chrono::milliseconds(500 + rng() % (maxMs - 500));
+		auto deadline = TimerWheel::clock::now() + timeout;
+		wheel.schedule(timeout, [&, i, deadline]() {
+			late[i] = std::chrono::duration<double, std::milli>(TimerWheel::clock::now() - deadline).count();
+			++fired;
+		});
+	}
+	double cpuStart = cpuMs();
+	while (fired < timers)
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	double cpu = cpuMs() - cpuStart;
+
+	std::sort(late.begin(), late.end());
+	std::printf("%d timers, 500-%d ms\n", timers, maxMs);
+	std::printf("  arm %.0f ns, cancel %.0f ns per timer\n", armNs, cancelNs);
+	std::printf("  lateness p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+		late[timers / 2], late[timers * 99 / 100], late[timers - 1]);
+	std::printf("  cpu while pending %.0f ms\n", cpu);
+	return 0;
+}
@@ -150,6 +150,14 @@ typedef lib::function<bool(connection_hdl)> validate_handler;
  */
 typedef lib::function<void(connection_hdl)> http_handler;
 
+/// The type and function signature of a write complete handler
+/**
+ * The write complete handler is called after a write to the transport has
+ * finished successfully. The size_t argument is the total payload size of the
+ * data (non control) messages that write carried.
+ */
+typedef lib::function<void(connection_hdl,size_t)> write_complete_handler;
+
 //
 typedef lib::function<void(lib::error_code const & ec, size_t bytes_transferred)> read_handler;
 typedef lib::function<void(lib::error_code const & ec)> write_frame_handler;
@@ -474,6 +482,29 @@ public:
         m_message_handler = h;
     }
 
+    /// Set write complete handler
+    /**
+     * The write complete handler is called after queued messages have been
+     * written to the transport.
+     *
+     * @param h The new write_complete_handler
+     */
+    void set_write_complete_handler(write_complete_handler h) {
+        m_write_complete_handler = h;
+    }
+
+    /// Set payload handler
+    /**
+     * The payload handler takes the payload of incoming data messages in
+     * pieces as it is read; the message handler then gets the message with
+     * an empty payload. Must be set before the connection is opened.
+     *
+     * @param h The new payload handler
+     */
+    void set_payload_handler(lib::function<void(char const *, size_t)> h) {
+        m_payload_handler = h;
+    }
+
     //////////////////////////////////////////
     // Connection timeouts and other limits //
     //////////////////////////////////////////
@@ -1510,6 +1541,8 @@ private:
     http_handler            m_http_handler;
     validate_handler        m_validate_handler;
     message_handler         m_message_handler;
+    write_complete_handler  m_write_complete_handler;
+    lib::function<void(char const *, size_t)> m_payload_handler;
 
     /// constant values
     long                    m_open_handshake_timeout_dur;
@@ -766,6 +766,9 @@ void connection<config>::handle_transport_init(lib::error_code const & ec) {
         // config file and send a handshake request.
         m_internal_state = istate::WRITE_HTTP_REQUEST;
         m_processor = get_processor(config::client_version);
+        if (m_processor && m_payload_handler) {
+            m_processor->set_payload_handler(m_payload_handler);
+        }
         this->send_http_request();
     }
 }
@@ -1145,6 +1148,9 @@ lib::error_code connection<config>::initialize_processor() {
     }
 
     m_processor = get_processor(version);
+    if (m_processor && m_payload_handler) {
+        m_processor->set_payload_handler(m_payload_handler);
+    }
 
     // if the processor is not null we are done
     if (m_processor) {
@@ -1894,6 +1900,15 @@ void connection<config>::handle_write_frame(lib::error_code const & ec)
 
     bool terminal = m_current_msgs.back()->get_terminal();
 
+    size_t written = 0;
+    if (m_write_complete_handler) {
+        for (size_t i = 0; i < m_current_msgs.size(); i++) {
+            if (!frame::opcode::is_control(m_current_msgs[i]->get_opcode())) {
+                written += m_current_msgs[i]->get_payload().size();
+            }
+        }
+    }
+
     m_send_buffer.clear();
     m_current_msgs.clear();
     // TODO: recycle instead of deleting
@@ -1904,6 +1919,10 @@ void connection<config>::handle_write_frame(lib::error_code const & ec)
         return;
     }
 
+    if (m_write_complete_handler) {
+        m_write_complete_handler(m_connection_hdl, written);
+    }
+
     if (terminal) {
         this->terminate(lib::error_code());
         return;
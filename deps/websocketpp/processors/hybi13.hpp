@@ -74,6 +74,7 @@ public:
       , m_msg_manager(manager)
       , m_rng(rng)
     {
+        m_payload_size = 0;
         reset_headers();
     }
 
@@ -442,9 +443,10 @@ public:
                         }
                         
                         m_data_msg = msg_metadata(
-                            m_msg_manager->get_message(op,m_bytes_needed),
+                            m_msg_manager->get_message(op,m_payload_handler ? 0 : m_bytes_needed),
                             frame::get_masking_key(m_basic_header,m_extended_header)
                         );
+                        m_payload_size = 0;
                         
                         if (m_permessage_deflate.is_enabled()) {
                             m_data_msg.msg_ptr->set_compressed(frame::get_rsv1(m_basic_header));
@@ -454,7 +456,8 @@ public:
                         // are writing into.
                         std::string & out = m_data_msg.msg_ptr->get_raw_payload();
                         
-                        if (out.size() + m_bytes_needed > base::m_max_message_size) {
+                        size_t size = m_payload_handler ? m_payload_size : out.size();
+                        if (size + m_bytes_needed > base::m_max_message_size) {
                             ec = make_error_code(error::message_too_big);
                             break;
                         }
@@ -468,7 +471,9 @@ public:
                             )
                         );
                         
-                        out.reserve(out.size() + m_bytes_needed);
+                        if (!m_payload_handler) {
+                            out.reserve(out.size() + m_bytes_needed);
+                        }
                     }
                     m_current_msg = &m_data_msg;
                 }
@@ -830,11 +835,21 @@ protected:
             }
         }
 
+        if (m_payload_handler && m_current_msg == &m_data_msg) {
+            m_payload_size += out.size() - offset;
+            m_payload_handler(out.data() + offset, out.size() - offset);
+            out.resize(offset);
+        }
+
         m_bytes_needed -= len;
 
         return len;
     }
 
+    void set_payload_handler(lib::function<void(char const *, size_t)> h) {
+        m_payload_handler = h;
+    }
+
     /// Validate an incoming basic header
     /**
      * Validates an incoming hybi13 basic header.
@@ -1054,6 +1069,11 @@ protected:
 
     // Metadata for the current data msg
     msg_metadata m_data_msg;
+
+    // Takes data message payload as it is read, see set_payload_handler
+    lib::function<void(char const *, size_t)> m_payload_handler;
+    // Payload of the current data message passed to m_payload_handler so far
+    size_t m_payload_size;
     // Metadata for the current control msg
     msg_metadata m_control_msg;
 
@@ -30,6 +30,7 @@
 
 #include <websocketpp/processors/base.hpp>
 #include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/functional.hpp>
 
 #include <websocketpp/close.hpp>
 #include <websocketpp/utilities.hpp>
@@ -173,6 +174,15 @@ public:
 
     virtual ~processor() {}
 
+    /// Set a handler that takes data message payload as it is read
+    /**
+     * When set, unmasked and decompressed payload of data messages is passed
+     * to the handler in pieces as it arrives instead of being collected in
+     * the message, which is still delivered, with an empty payload, once
+     * complete. Processors that do not support this ignore it.
+     */
+    virtual void set_payload_handler(lib::function<void(char const *, size_t)>) {}
+
     /// Get the protocol version of this processor
     virtual int get_version() const = 0;
 
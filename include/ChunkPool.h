@@ -0,0 +1,63 @@
+#ifndef CHAI51_CHUNK_POOL
+#define CHAI51_CHUNK_POOL
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/utility/string_view.hpp>
+
+#include "json.hpp"
+
+namespace protoo
+{
+	// A serialized message split into chunks that each end on a UTF-8
+	// boundary, so every chunk can go out as one WebSocket fragment.
+	typedef struct
+	{
+		std::vector<std::string> chunks;
+		size_t size{ 0 };
+	}chunked_t;
+
+	// Recycles full-size chunk buffers between the threads that serialize
+	// messages and the io thread that writes them.
+	class ChunkPool
+	{
+	public:
+		// chunkSize zero keeps every message in one chunk
+		ChunkPool(size_t chunkSize, size_t maxIdle = 16);
+
+		// Serializes message like json::dump, straight into chunks.
+		void dump(const nlohmann::json& message, chunked_t& out);
+		// As above, with raw added to the object message as the value of key.
+		// raw is copied as is, so it must be valid JSON; if empty, key is left out.
+		void dump(const nlohmann::json& message, const std::string& key, boost::string_view raw, chunked_t& out);
+		void put(std::string&& chunk);
+		size_t chunk_size() const { return chunk_size_; }
+
+	protected:
+		std::string get();
+		void begin(chunked_t& out);
+		void end(chunked_t& out);
+
+		class writer_t : public nlohmann::detail::output_adapter_protocol<char>
+		{
+		public:
+			writer_t(ChunkPool& pool, chunked_t& out);
+			void write_character(char c) override;
+			void write_characters(const char* s, std::size_t length) override;
+		private:
+			void seal();
+
+			ChunkPool& pool_;
+			chunked_t& out_;
+		};
+
+	private:
+		size_t chunk_size_;
+		size_t max_idle_;
+		std::mutex mtx_;
+		std::vector<std::string> idle_;
+	};
+}
+
+#endif	// CHAI51_CHUNK_POOL
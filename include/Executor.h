@@ -0,0 +1,26 @@
+#ifndef CHAI51_EXECUTOR
+#define CHAI51_EXECUTOR
+
+#include <functional>
+#include <memory>
+
+#include <boost/asio/io_context.hpp>
+
+#include "ThreadPool.h"
+#include "WorkStealingPool.h"
+
+namespace protoo
+{
+	// Runs a task somewhere else, e.g. posts it to an io_context or a pool.
+	typedef std::function<void(std::function<void(void)>)> executor;
+
+	// Runs the task on the calling thread before returning.
+	executor inlineExecutor();
+	// Posts to a new strand of ioc: tasks never run concurrently with each
+	// other and run in the order posted. ioc must outlive the executor.
+	executor strandExecutor(boost::asio::io_context& ioc);
+	executor poolExecutor(std::shared_ptr<ThreadPool> pool);
+	executor stealingExecutor(std::shared_ptr<WorkStealingPool> pool);
+}
+
+#endif	// CHAI51_EXECUTOR
@@ -0,0 +1,37 @@
+#ifndef CHAI51_HISTOGRAM
+#define CHAI51_HISTOGRAM
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace protoo
+{
+	// Lock-free latency histogram with power-of-two microsecond buckets:
+	// bucket 0 counts samples below 1 us, bucket i samples in [2^(i-1), 2^i) us.
+	class Histogram
+	{
+	public:
+		static const size_t kBuckets = 40;
+
+		Histogram();
+		Histogram(const Histogram&) = delete;
+		Histogram& operator=(const Histogram&) = delete;
+
+		void record(std::chrono::steady_clock::duration d);
+
+		uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+		uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+		// Upper bound in microseconds of the bucket holding the p-th percentile.
+		uint64_t percentile(double p) const;
+		std::vector<uint64_t> buckets() const;
+
+	private:
+		std::atomic<uint64_t> buckets_[kBuckets];
+		std::atomic<uint64_t> count_{ 0 };
+		std::atomic<uint64_t> sum_{ 0 };
+	};
+}
+
+#endif	// CHAI51_HISTOGRAM
@@ -0,0 +1,91 @@
+#ifndef CHAI51_JSON_PUSH_PARSER
+#define CHAI51_JSON_PUSH_PARSER
+
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+namespace protoo
+{
+	// Resumable JSON parser fed in arbitrary pieces, e.g. as a WebSocket
+	// message arrives, building the value as it goes so the text need not be
+	// kept. Accepts what nlohmann::json::parse accepts, except that UTF-8 is
+	// not validated (websocketpp already does for text frames), and that the
+	// raw member, if set, is only checked for balanced brackets.
+	class JsonPushParser
+	{
+	public:
+		JsonPushParser();
+
+		// The value of this member of a top-level object is not parsed but
+		// kept as text, and left out of the object; see finish().
+		void set_raw_member(const std::string& key) { raw_member_ = key; }
+
+		// After an error the rest of the input is ignored until finish().
+		void feed(const char* data, size_t size);
+		// The parsed value; throws std::invalid_argument if the input was not
+		// one complete JSON value. raw gets the raw member's text, or is
+		// cleared if there was none. Either way the parser is ready for the next.
+		nlohmann::json finish(std::string* raw = nullptr);
+		void reset();
+
+	protected:
+		enum class state_t
+		{
+			value,			// a value, or ']' right after '['
+			after_value,	// ',' or a closing bracket
+			key,			// an object key, or '}' right after '{'
+			colon,
+			string,
+			escape,
+			unicode,
+			number,
+			literal,
+			raw,
+			done,
+			failed
+		};
+
+		typedef struct
+		{
+			nlohmann::json* value;
+			std::string key;
+		}frame_t;
+
+		size_t parseString(const char* p, const char* end);
+		size_t parseRaw(const char* p, const char* end);
+		void parseEscape(char c);
+		void parseUnicode(char c);
+		void endNumber();
+		void beginValue(nlohmann::json&& value);
+		void endValue();
+		nlohmann::json& slot();
+		void fail(const char* reason);
+
+	private:
+		state_t state_;
+		nlohmann::json root_;
+		std::vector<frame_t> stack_;
+		// the innermost container has no elements yet
+		bool first_{ false };
+		// string or object key being read, and whether it is a key
+		std::string text_;
+		bool is_key_{ false };
+		uint32_t code_{ 0 };
+		uint32_t high_surrogate_{ 0 };
+		int hex_digits_{ 0 };
+		// number or literal being read
+		std::string token_;
+		const char* literal_{ nullptr };
+		std::string error_;
+		// raw member text, its bracket depth and string state while read
+		std::string raw_member_;
+		std::string raw_;
+		size_t raw_depth_{ 0 };
+		bool raw_string_{ false };
+		bool raw_escape_{ false };
+	};
+}
+
+#endif	// CHAI51_JSON_PUSH_PARSER
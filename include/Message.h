@@ -0,0 +1,56 @@
+#ifndef CHAI51_MESSAGE
+#define CHAI51_MESSAGE
+
+#include <string>
+#include <boost/utility/string_view.hpp>
+
+#include "json.hpp"
+
+namespace protoo
+{
+	// An inbound protoo message whose envelope (request, response,
+	// notification, id, method, ok, errorCode, errorReason) is parsed, while
+	// data may still be the raw JSON text, parsed the first time it is asked
+	// for. Messages that are dropped or answered without looking at data never
+	// build it. Not thread safe; hand it to one thread at a time.
+	class Message
+	{
+	public:
+		Message() = default;
+		// envelope without data, and data's raw text (empty if absent)
+		Message(nlohmann::json&& envelope, std::string&& rawData);
+		// a message already parsed as a whole, e.g. an element of a batch
+		explicit Message(nlohmann::json&& message);
+
+		bool is_batch() const { return envelope_.is_array(); }
+		bool is_request() const { return has("request"); }
+		bool is_response() const { return has("response"); }
+		bool is_notification() const { return has("notification"); }
+		const nlohmann::json& envelope() const { return envelope_; }
+		// empty if absent or not a string
+		const std::string& method() const;
+		const nlohmann::json& id() const;
+		bool ok() const;
+
+		bool has_data() const { return parsed_ || !raw_.empty(); }
+		// Parses data on the first call; throws std::invalid_argument if the raw
+		// text is not JSON. Null if the message has none.
+		const nlohmann::json& data();
+		// data as received, until data() or release(); empty if data came
+		// parsed or is absent
+		boost::string_view raw_data() const { return raw_; }
+		// The whole message, data included, leaving this one empty.
+		nlohmann::json release();
+
+	protected:
+		bool has(const char* key) const;
+
+	private:
+		nlohmann::json envelope_;
+		std::string raw_;
+		nlohmann::json data_;
+		bool parsed_{ false };
+	};
+}
+
+#endif	// CHAI51_MESSAGE
@@ -0,0 +1,99 @@
+#ifndef CHAI51_METHOD_TABLE
+#define CHAI51_METHOD_TABLE
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace protoo
+{
+	// Open-addressing table from method name to handler. Each registered name
+	// is stored once together with its precomputed 64-bit hash, so a lookup
+	// hashes the incoming name once and only compares strings on a full hash
+	// match. Not synchronized: register handlers before messages can arrive.
+	template<typename H>
+	class MethodTable
+	{
+		typedef struct
+		{
+			uint64_t hash;
+			std::string method;
+			H handler;
+		}entry_t;
+	public:
+		MethodTable() : entries_(16) {}
+
+		void set(const std::string& method, H handler)
+		{
+			if (!handler)
+				return;
+			if ((size_ + 1) * 2 > entries_.size())
+				rehash(entries_.size() * 2);
+
+			uint64_t hash = hashOf(method.data(), method.size());
+			entry_t* entry = probe(hash, method.data(), method.size());
+			if (!entry->handler)
+				++size_;
+			entry->hash = hash;
+			entry->method = method;
+			entry->handler = std::move(handler);
+		}
+
+		// Returns nullptr when no handler is registered for method.
+		const H* find(const std::string& method) const
+		{
+			if (!size_)
+				return nullptr;
+
+			uint64_t hash = hashOf(method.data(), method.size());
+			const entry_t* entry = const_cast<MethodTable*>(this)->probe(hash, method.data(), method.size());
+			return entry->handler ? &entry->handler : nullptr;
+		}
+
+		size_t size() const { return size_; }
+
+	protected:
+		static uint64_t hashOf(const char* data, size_t size)
+		{
+			// FNV-1a
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < size; ++i)
+			{
+				hash ^= uint8_t(data[i]);
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		entry_t* probe(uint64_t hash, const char* method, size_t size)
+		{
+			size_t mask = entries_.size() - 1;
+			for (size_t i = size_t(hash) & mask;; i = (i + 1) & mask)
+			{
+				entry_t& entry = entries_[i];
+				if (!entry.handler)
+					return &entry;
+				if (entry.hash == hash && entry.method.compare(0, std::string::npos, method, size) == 0)
+					return &entry;
+			}
+		}
+
+		void rehash(size_t capacity)
+		{
+			std::vector<entry_t> entries(capacity);
+			std::swap(entries, entries_);
+			for (auto& entry : entries)
+			{
+				if (!entry.handler)
+					continue;
+				*probe(entry.hash, entry.method.data(), entry.method.size()) = std::move(entry);
+			}
+		}
+
+	private:
+		std::vector<entry_t> entries_;
+		size_t size_{ 0 };
+	};
+}
+
+#endif	// CHAI51_METHOD_TABLE
@@ -0,0 +1,60 @@
+#ifndef CHAI51_MPSC_QUEUE
+#define CHAI51_MPSC_QUEUE
+
+#include <atomic>
+
+namespace protoo
+{
+	// Unbounded lock-free queue for many producers and one consumer (Vyukov).
+	// push() is a single exchange; pop() may briefly miss an element whose
+	// producer has not linked it yet, so consumers are re-signalled by the
+	// producer after push() rather than relying on pop() to see everything.
+	template<typename T>
+	class MpscQueue
+	{
+		struct node_t
+		{
+			std::atomic<node_t*> next{ nullptr };
+			T value;
+		};
+	public:
+		MpscQueue() : head_(new node_t), tail_(head_.load()) {}
+		MpscQueue(const MpscQueue&) = delete;
+		MpscQueue& operator=(const MpscQueue&) = delete;
+		~MpscQueue()
+		{
+			T value;
+			while (pop(value))
+				;
+			delete tail_;
+		}
+
+		void push(T value)
+		{
+			node_t* node = new node_t;
+			node->value = std::move(value);
+			node_t* prev = head_.exchange(node, std::memory_order_acq_rel);
+			prev->next.store(node, std::memory_order_release);
+		}
+
+		// consumer only
+		bool pop(T& value)
+		{
+			node_t* tail = tail_;
+			node_t* next = tail->next.load(std::memory_order_acquire);
+			if (!next)
+				return false;
+
+			value = std::move(next->value);
+			tail_ = next;
+			delete tail;
+			return true;
+		}
+
+	private:
+		std::atomic<node_t*> head_;
+		node_t* tail_;
+	};
+}
+
+#endif	// CHAI51_MPSC_QUEUE
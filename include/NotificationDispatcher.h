@@ -0,0 +1,74 @@
+#ifndef CHAI51_NOTIFICATION_DISPATCHER
+#define CHAI51_NOTIFICATION_DISPATCHER
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.hpp"
+#include "Executor.h"
+#include "NotificationQueue.h"
+
+namespace protoo
+{
+	// Spreads notifications over N worker lanes. Notifications with the same
+	// key always land on the same lane, so they are delivered in order while
+	// unrelated keys proceed in parallel. Without a key (or an extractor) the
+	// method name is used.
+	//
+	// Each lane is drained either by its own thread or, given an executor, by
+	// drain tasks posted to it; at most one drain task per lane is in flight.
+	class NotificationDispatcher
+	{
+	public:
+		typedef std::function<void(const nlohmann::json&)> dispatch_handler;
+
+		NotificationDispatcher(dispatch_handler h, const notification_options& options = notification_options());
+		NotificationDispatcher(dispatch_handler h, const notification_options& options, executor ex);
+		~NotificationDispatcher();
+
+		bool push(nlohmann::json&& message);
+		void close();
+		size_t workers() const { return lanes_.size(); }
+		// Summed over all lanes; high_water is the largest lane's.
+		notification_stats stats() const;
+
+		// Extractor returning notification["data"][field], e.g. "consumerId".
+		static key_extractor dataKey(const std::string& field);
+
+	protected:
+		struct lane_t
+		{
+			lane_t(const notification_options& options)
+				: queue(options.capacity, options.policy, options.key, options.coalesce)
+			{
+			}
+
+			NotificationQueue queue;
+			dispatch_handler handler;
+			executor ex;
+			std::atomic<bool> scheduled{ false };
+			// held while a drain task delivers; close() takes it to wait them out
+			std::recursive_mutex mtx;
+			bool closed{ false };
+		};
+
+		void run(NotificationQueue* queue);
+		static void schedule(const std::shared_ptr<lane_t>& lane);
+		static size_t drain(lane_t& lane, size_t batch);
+		size_t laneOf(const nlohmann::json& message) const;
+
+	private:
+		dispatch_handler handler_;
+		key_extractor key_;
+		executor executor_;
+		std::vector<std::shared_ptr<lane_t>> lanes_;
+		std::vector<std::thread> threads_;
+	};
+}
+
+#endif	// CHAI51_NOTIFICATION_DISPATCHER
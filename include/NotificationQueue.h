@@ -0,0 +1,143 @@
+#ifndef CHAI51_NOTIFICATION_QUEUE
+#define CHAI51_NOTIFICATION_QUEUE
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "json.hpp"
+
+namespace protoo
+{
+	typedef std::function<std::string(const nlohmann::json&)> key_extractor;
+	// method -> key of the entity a notification describes. Only the newest
+	// queued notification per (method, key) is delivered; a null extractor
+	// keeps one per method.
+	typedef std::unordered_map<std::string, key_extractor> coalesce_registry;
+
+	// The message's method, or an empty string if absent or not a string.
+	const std::string& methodOf(const nlohmann::json& message);
+
+	// What push() does when the ring is full.
+	enum class OverflowPolicy
+	{
+		grow,			// queue the message in an unbounded spill list
+		block,			// wait for the consumer; stalls the transport thread
+		drop_oldest,	// discard the oldest queued message
+		drop_newest,	// discard the incoming message
+		coalesce_by_key	// replace the queued message with the same method and key,
+						// otherwise discard the incoming message
+	};
+
+	typedef struct
+	{
+		uint64_t queued;
+		uint64_t dropped;
+		uint64_t coalesced;
+		size_t high_water;
+	}notification_stats;
+
+	typedef struct
+	{
+		size_t workers{ 1 };
+		// keeps notifications of one entity on one worker, see NotificationDispatcher
+		key_extractor key;
+		// per worker
+		size_t capacity{ 1024 };
+		OverflowPolicy policy{ OverflowPolicy::grow };
+		coalesce_registry coalesce;
+	}notification_options;
+
+	// Lock-free ring (Vyukov) between the transport thread and the
+	// notification thread. The consumer spins briefly before parking, and
+	// producers only touch the mutex when the consumer is actually parked.
+	// Under the grow policy messages that do not fit go to a locked spill
+	// list, which the consumer drains after the ring.
+	class NotificationQueue
+	{
+	public:
+		// capacity is rounded up to a power of two
+		NotificationQueue(size_t capacity = 1024, OverflowPolicy policy = OverflowPolicy::grow, key_extractor key = nullptr,
+			coalesce_registry coalesce = coalesce_registry());
+
+		// Returns false once closed. Depending on the policy the message may
+		// have been dropped or coalesced instead of queued.
+		bool push(nlohmann::json&& message);
+		// Blocks until a message arrives; returns false once closed.
+		bool pop(nlohmann::json& message);
+		// Non-blocking pop.
+		bool poll(nlohmann::json& message);
+		// Called by a producer about to wait on a full ring under the block
+		// policy, so an executor-driven consumer can make room inline.
+		void set_full_handler(std::function<void(void)> h) { full_handler_ = std::move(h); }
+		void close();
+
+		size_t capacity() const { return mask_ + 1; }
+		size_t size() const;
+		notification_stats stats() const;
+
+	protected:
+		typedef struct
+		{
+			std::string key;
+			nlohmann::json message;
+		}pending_t;
+
+		bool tryPush(nlohmann::json& message, std::shared_ptr<pending_t>& pending);
+		void spill(nlohmann::json& message, std::shared_ptr<pending_t>& pending);
+		bool tryPop(nlohmann::json& message, std::shared_ptr<pending_t>& pending);
+		bool enqueue(nlohmann::json& message, std::shared_ptr<pending_t>& pending);
+		bool enqueueCoalesced(nlohmann::json& message, std::shared_ptr<pending_t>& pending);
+		std::string coalesceKey(const nlohmann::json& message) const;
+		void forget(const std::shared_ptr<pending_t>& pending);
+		void take(nlohmann::json& message, std::shared_ptr<pending_t>& pending);
+		void onQueued();
+		void wakeConsumer();
+		void wakeProducers();
+
+		typedef struct
+		{
+			std::atomic<size_t> sequence;
+			nlohmann::json data;
+			std::shared_ptr<pending_t> pending;
+		}cell_t;
+	private:
+		std::unique_ptr<cell_t[]> cells_;
+		size_t mask_;
+		const OverflowPolicy policy_;
+		const key_extractor key_;
+		const coalesce_registry coalesce_;
+		std::function<void(void)> full_handler_;
+		alignas(64) std::atomic<size_t> enqueue_pos_{ 0 };
+		alignas(64) std::atomic<size_t> dequeue_pos_{ 0 };
+
+		alignas(64) std::atomic<bool> sleeping_{ false };
+		std::atomic<int> producers_waiting_{ 0 };
+		std::atomic<bool> closed_{ false };
+		std::mutex mtx_;
+		std::condition_variable cond_consumer_;
+		std::condition_variable cond_producer_;
+
+		// grow only; while not empty, new messages go here to keep the order
+		std::mutex mtx_spill_;
+		std::deque<std::pair<nlohmann::json, std::shared_ptr<pending_t>>> spill_;
+		std::atomic<size_t> spilled_{ 0 };
+
+		// latest queued message per (method, key)
+		std::mutex mtx_pending_;
+		std::unordered_map<std::string, std::shared_ptr<pending_t>> pending_;
+
+		std::atomic<uint64_t> queued_{ 0 };
+		std::atomic<uint64_t> dropped_{ 0 };
+		std::atomic<uint64_t> coalesced_{ 0 };
+		std::atomic<size_t> high_water_{ 0 };
+	};
+}
+
+#endif	// CHAI51_NOTIFICATION_QUEUE
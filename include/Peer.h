@@ -2,12 +2,21 @@
 #define CHAI51_PEER
 
 #include <stdint.h>
+#include <atomic>
 #include <memory>
-#include <random>
+#include <mutex>
 #include <functional>
+#include <future>
 
 #include "json.hpp"
 #include "WebSocketTransport.h"
+#include "Executor.h"
+#include "TimerWheel.h"
+#include "SlotTable.h"
+#include "NotificationDispatcher.h"
+#include "MethodTable.h"
+#include "ThreadPool.h"
+#include "Histogram.h"
 
 namespace protoo
 {
@@ -22,66 +31,265 @@ namespace protoo
 	typedef std::function<void(const json&)> accept_handler;
 	typedef std::function<void(int, const char*)> reject_handler;
 	typedef std::function<void(const json&, accept_handler, reject_handler)> request_handler;
+
+	// Owns an inbound request and answers it. Copies share one response, so a
+	// handler may keep a copy and accept or reject later from any thread; only
+	// the first answer is sent, and answers after the peer is gone are dropped.
+	class Responder
+	{
+		friend class Peer;
+	public:
+		// The request and its data are parsed on first use, on whichever
+		// thread asks; throws std::invalid_argument if data is not JSON.
+		const json& request() const;
+		const json& data() const;
+		void accept(const json& data = json::object()) const;
+		void reject(int errorCode, const std::string& errorReason) const;
+		bool done() const { return state_->done; }
+
+	protected:
+		typedef struct
+		{
+			std::mutex mtx;
+			WebSocketTransport* transport;
+		}link_t;
+
+		struct state_t
+		{
+			Message message;
+			json id;
+			std::once_flag parsed;
+			json request;
+			std::shared_ptr<link_t> link;
+			std::atomic<bool> done{ false };
+			// called once, on the first answer or when the last copy goes away
+			std::function<void(void)> finished;
+
+			~state_t() { if (finished) finished(); }
+		};
+
+		Responder(Message&& request, std::shared_ptr<link_t> link);
+		void respond(json&& response) const;
+	private:
+		std::shared_ptr<state_t> state_;
+	};
+
+	typedef std::function<void(Responder)> async_request_handler;
 	typedef std::function<void(const json&)> notification_handler;
+	// notification without its data member, and data's JSON text
+	typedef std::function<void(const json& notification, boost::string_view data)> raw_notification_handler;
+
+	// error is null on success, otherwise data is null
+	typedef std::function<void(const json& data, std::exception_ptr error)> response_handler;
+	// index of the request in the submitted list, then as response_handler
+	typedef std::function<void(size_t index, const json& data, std::exception_ptr error)> pipeline_handler;
+
+	enum class PeerThreading
+	{
+		threaded,		// open handler, timeouts and notifications on threads of their own
+		single_threaded	// everything inline on the transport's io thread
+	};
+
+	// Handlers that can be bound to an executor with Peer::set_executor.
+	enum class HandlerCategory
+	{
+		open,
+		disconnected,
+		close,
+		failed,
+		request,
+		notification
+	};
 
 	class Peer
 	{
 	public:
 		Peer(std::unique_ptr<WebSocketTransport> transport);
+		// single_threaded runs every handler on the transport's io thread with no
+		// handoff: notifications skip the dispatcher, so set_notification_workers
+		// and set_notification_backlog do not apply, and handlers must not block.
+		Peer(std::unique_ptr<WebSocketTransport> transport, PeerThreading threading);
+		// Runs timeouts, notification dispatch and the open handler on ioc
+		// instead of private threads. Handlers then run on ioc's threads, so
+		// they must not block on request(); use requestAsync().
+		Peer(std::unique_ptr<WebSocketTransport> transport, boost::asio::io_context& ioc);
+		// As above, but request timeouts are tracked by a wheel shared with other
+		// peers, and notifications are drained on notificationExecutor (ioc when
+		// null). See PeerManager.
+		Peer(std::unique_ptr<WebSocketTransport> transport, boost::asio::io_context& ioc,
+			std::shared_ptr<TimerWheel> timer, executor notificationExecutor = nullptr);
 		~Peer();
+		// Throws when called on the io thread of a peer running on an io_context,
+		// since the response could never be read; use requestAsync() there.
 		json request(const std::string& method, const json& data);
+		std::future<json> requestAsync(const std::string& method, const json& data);
+		void requestAsync(const std::string& method, const json& data, response_handler h);
+		void requestAsync(const std::string& method, const json& data, executor ex, response_handler h);
 		void notify(const std::string& method, const json& data);
+		// data is already serialized JSON and is sent as is, e.g. as received
+		// by a raw_notification_handler. Empty data leaves the member out.
+		void notifyRaw(const std::string& method, boost::string_view data);
+		// Sent as one frame when the transport batches (see BatchMode), otherwise
+		// one message each. Futures are in the order of requests.
+		std::vector<std::future<json>> requestBatch(const std::vector<std::pair<std::string, json>>& requests);
+		void notifyMany(const std::vector<std::pair<std::string, json>>& notifications);
+		// Issues the requests keeping at most window of them unanswered. h gets
+		// every result, never concurrently: in submission order when ordered,
+		// otherwise as they complete. The future is ready after the last one.
+		std::future<void> requestPipeline(std::vector<std::pair<std::string, json>> requests, size_t window, bool ordered,
+			pipeline_handler h);
 		void close();
 		void set_open_handler(open_handler h) { open_handler_ = h; }
 		void set_disconnected_handler(disconnected_handler h) { disconnected_handler_ = h; }
 		void set_close_handler(close_handler h) { close_handler_ = h; }
 		void set_failed_handler(failed_handler h) { failed_handler_ = h; }
-		void set_request_handler(request_handler h) { request_handler_ = h; }
+		// Called on the thread that crossed the mark: high from a sending thread,
+		// low from the io thread. See WebSocketTransport::set_watermarks.
+		void set_high_water_handler(event_handler h) { high_water_handler_ = h; }
+		void set_low_water_handler(event_handler h) { low_water_handler_ = h; }
+		void set_request_handler(request_handler h) { request_handler_ = wrap(h); }
 		void set_notification_handler(notification_handler h) { notification_handler_ = h; }
+		// Per-method handlers, registered before the peer opens. Methods without
+		// one fall back to the request/notification handler set above.
+		void onRequest(const std::string& method, request_handler h) { request_handlers_.set(method, wrap(h)); }
+		void onAsyncRequest(const std::string& method, async_request_handler h) { request_handlers_.set(method, h); }
+		void onNotification(const std::string& method, notification_handler h) { notification_handlers_.set(method, h); }
+		void set_async_request_handler(async_request_handler h) { request_handler_ = h; }
+		// For forwarding data without parsing it. Called on the transport's io
+		// thread as the message is read, so must not block; data only lives
+		// until it returns, and is empty if the notification has none.
+		// Registered for a method it takes precedence over onNotification; the
+		// default one only gets methods with no other handler, so it yields to
+		// set_notification_handler too.
+		void onRawNotification(const std::string& method, raw_notification_handler h) { raw_notification_handlers_.set(method, h); }
+		void set_raw_notification_handler(raw_notification_handler h) { raw_notification_handler_ = h; }
+		// Must be called before the peer opens. Runs request handlers on a pool
+		// of threads instead of the transport thread. Once maxConcurrency
+		// requests are unanswered, new ones are rejected with busyCode.
+		void set_request_workers(size_t threads, size_t maxConcurrency, int busyCode = 503);
+		const Histogram& get_request_queue_wait() const { return request_metrics_->queue_wait; }
+		const Histogram& get_request_duration() const { return request_metrics_->duration; }
+		uint64_t get_request_rejected() const { return request_metrics_->rejected; }
+		// Must be called before the peer opens. With workers > 1 the handler is
+		// called concurrently, but in order for notifications sharing a key.
+		void set_notification_workers(size_t workers, key_extractor key = nullptr) { notification_options_.workers = workers; notification_options_.key = key; }
+		// Must be called before the peer opens. Capacity is per worker; the
+		// coalesce_by_key policy uses the key given to set_notification_workers.
+		// The default, grow, never blocks the transport thread; block does, so
+		// a handler calling request() could then not get its response.
+		void set_notification_backlog(size_t capacity, OverflowPolicy policy) { notification_options_.capacity = capacity; notification_options_.policy = policy; }
+		// Must be called before the peer opens. Queued notifications of this
+		// method are replaced in place by newer ones with the same key, e.g.
+		// set_coalesced_notification("consumerScore", NotificationDispatcher::dataKey("consumerId")).
+		void set_coalesced_notification(const std::string& method, key_extractor key = nullptr) { notification_options_.coalesce[method] = key; }
+		notification_stats get_notification_stats();
+		// Must be called before the peer opens. Runs the category's handlers on ex
+		// rather than on whichever thread raised them; tasks still queued when
+		// the peer is destroyed are dropped. Takes precedence over
+		// set_request_workers and the notification workers' threads.
+		void set_executor(HandlerCategory category, executor ex);
+		// Time from handing a task to the category's executor until it runs.
+		// Notifications are handed over in batches, one sample per batch.
+		const Histogram& get_executor_latency(HandlerCategory category) const { return *executor_latency_[size_t(category)]; }
+
+		// Must be called before the peer opens.
+		void set_watermarks(size_t high, size_t low) { transport_->set_watermarks(high, low); }
+		// What notify and notifyMany do above the high water mark.
+		void set_notify_backpressure(BackpressurePolicy policy) { notify_backpressure_ = policy; }
+		size_t get_buffered_amount() const { return transport_->get_buffered_amount(); }
 
 		bool closed() { return closed_; }
 		bool connected() { return connected_; }
 	protected:
+		void init();
 		void onOpen();
 		void onDisconnected();
 		void onFailed(int currentAttempt);
 		void onClose();
-		void onMessage(const json& message);
+		void onHighWater();
+		void onLowWater();
+		void onMessage(Message&& message);
 
-		void handleRequest(const json& request);
-		void handleResponse(const json& response);
-		void handleNotification();
+		void handleRequest(Message&& request);
+		void runRequest(const async_request_handler& handler, Responder responder, std::chrono::steady_clock::time_point received);
+		static async_request_handler wrap(request_handler h);
+		void handleResponse(Message& response);
+		void handleNotification(const json& notification);
+		void handleRawNotification(const raw_notification_handler& handler, Message& notification);
 
-		void onTimer();
+		bool dispatch(HandlerCategory category, std::function<void(void)> task);
+		// task, skipped if the peer is destroyed before it gets to run
+		std::function<void(void)> guarded(std::function<void(void)> task) const;
+
+		struct pipeline_t;
+		static void issue(Peer* peer, const std::shared_ptr<pipeline_t>& pipeline);
+		static void complete(Peer* peer, const std::shared_ptr<pipeline_t>& pipeline, size_t index, const json& data, std::exception_ptr error);
+
+		int track(response_handler& h);
+		void fail(int id, std::exception_ptr error);
+		static response_handler fulfil(std::shared_ptr<std::promise<json>> promise);
+		static json makeRequest(int id, const std::string& method, const json& data);
+		static json makeNotification(const std::string& method, const json& data);
+
+		// static: the wheel may be shared and fire after the peer is gone
+		static void onRequestTimeout(Peer* peer, std::shared_ptr<Responder::link_t> link, int id);
+		void failSents(const char* reason);
 
 		typedef struct 
 		{
-			std::promise<json> promise;
-			std::chrono::steady_clock::time_point clock;
+			response_handler handler;
+			TimerWheel::timer_id timer;
+			std::chrono::steady_clock::time_point sent;
 		}sent_t;
 	private:
 		std::unique_ptr<WebSocketTransport> transport_;
+		std::shared_ptr<Responder::link_t> link_;
 		bool closed_{ false };
 		bool connected_{ false };
-		std::random_device random_;
+		bool single_threaded_{ false };
 
-		std::map<int, sent_t> sents_;
-		std::mutex mtx_sents_;
+		SlotTable<sent_t> sents_;
+		boost::asio::io_context* ioc_{ nullptr };
+		std::shared_ptr<TimerWheel> timer_;
 
-		std::condition_variable cond_notification_;
-		std::mutex mtx_notification_;
-		std::list<json> notification_message_;
-		std::unique_ptr<std::thread> notification_thread_;
+		// created by the io thread on the first open; other threads read it
+		// under notifications_mtx_
+		std::unique_ptr<NotificationDispatcher> notifications_;
+		std::mutex notifications_mtx_;
+		notification_options notification_options_;
+		executor notification_executor_;
 
 		open_handler open_handler_;
 		disconnected_handler disconnected_handler_;
 		close_handler close_handler_;
 		failed_handler failed_handler_;
-		request_handler request_handler_;
+		event_handler high_water_handler_;
+		event_handler low_water_handler_;
+		BackpressurePolicy notify_backpressure_{ BackpressurePolicy::none };
+		async_request_handler request_handler_;
 		notification_handler notification_handler_;
+		MethodTable<async_request_handler> request_handlers_;
+		MethodTable<notification_handler> notification_handlers_;
+		raw_notification_handler raw_notification_handler_;
+		MethodTable<raw_notification_handler> raw_notification_handlers_;
+
+		typedef struct
+		{
+			std::atomic<size_t> in_flight{ 0 };
+			std::atomic<uint64_t> rejected{ 0 };
+			Histogram queue_wait;
+			Histogram duration;
+		}request_metrics_t;
+		std::shared_ptr<request_metrics_t> request_metrics_;
+		std::unique_ptr<ThreadPool> request_pool_;
+		size_t max_requests_{ 0 };
+		int busy_code_{ 503 };
+
+		static const size_t kHandlerCategories = 6;
+		executor executors_[kHandlerCategories];
+		std::shared_ptr<Histogram> executor_latency_[kHandlerCategories];
 
 		std::unique_ptr<std::thread> open_thread_;
-		std::unique_ptr<std::thread> timer_thread_;
 	};
 }
 
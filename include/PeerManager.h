@@ -0,0 +1,80 @@
+#ifndef CHAI51_PEER_MANAGER
+#define CHAI51_PEER_MANAGER
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Peer.h"
+#include "ThreadPool.h"
+#include "TimerWheel.h"
+
+namespace protoo
+{
+	enum class PeerAssignment
+	{
+		round_robin,
+		least_loaded	// fewest live peers
+	};
+
+	typedef struct
+	{
+		size_t threads{ 1 };
+		PeerAssignment assignment{ PeerAssignment::round_robin };
+		// 0 drains notifications on the peer's io thread
+		size_t notification_threads{ 0 };
+	}peer_manager_options;
+
+	// Hosts many peers on a fixed set of io threads. Each thread runs its own
+	// io_context and a timer wheel shared by every peer assigned to it; with
+	// notification_threads set, all peers drain notifications on one shared
+	// pool instead of their io thread.
+	class PeerManager
+	{
+	public:
+		// Called on the peer's io thread before it starts connecting, so handlers
+		// and worker settings are in place for the first event.
+		typedef std::function<void(Peer&)> setup_handler;
+
+		PeerManager(const peer_manager_options& options = peer_manager_options());
+		~PeerManager();
+
+		// Called from one of the manager's io threads, the peer is placed on
+		// that thread regardless of the assignment policy.
+		std::shared_ptr<Peer> create(const std::string& url, setup_handler setup = nullptr, void* options = nullptr);
+		// Stops the io threads. Peers still alive are no longer serviced.
+		void stop();
+
+		size_t threads() const { return reactors_.size(); }
+		size_t peers() const;
+		// live peers per io thread
+		std::vector<size_t> load() const;
+
+	protected:
+		struct reactor_t
+		{
+			reactor_t() : work(ioc.get_executor()), timer(std::make_shared<TimerWheel>(ioc)) {}
+
+			boost::asio::io_context ioc;
+			boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+			std::shared_ptr<TimerWheel> timer;
+			std::atomic<size_t> peers{ 0 };
+			std::thread thread;
+		};
+
+		std::shared_ptr<reactor_t> pick();
+		std::shared_ptr<Peer> createOn(const std::shared_ptr<reactor_t>& reactor, const std::string& url,
+			const setup_handler& setup, void* options);
+
+	private:
+		PeerAssignment assignment_;
+		std::vector<std::shared_ptr<reactor_t>> reactors_;
+		std::atomic<size_t> next_{ 0 };
+		std::shared_ptr<ThreadPool> notification_pool_;
+	};
+}
+
+#endif	// CHAI51_PEER_MANAGER
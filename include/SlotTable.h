@@ -0,0 +1,177 @@
+#ifndef CHAI51_SLOT_TABLE
+#define CHAI51_SLOT_TABLE
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace protoo
+{
+	// Pending-entry table addressed by generation-tagged ids.
+	//
+	// An id is (generation << 16 | slot index). Slots are allocated lazily in
+	// chunks and never freed, the free list is a tagged Treiber stack, and a
+	// lookup is an array index plus a compare-and-swap on the slot id, so a
+	// stale or duplicated id can never match a reused slot.
+	template<typename T>
+	class SlotTable
+	{
+		static const uint32_t kIndexBits = 16;
+		static const uint32_t kIndexMask = (1u << kIndexBits) - 1;
+		static const uint32_t kGenerationMask = 0x7fff;
+		static const uint32_t kChunkBits = 8;
+		static const uint32_t kChunkSize = 1u << kChunkBits;
+		static const uint32_t kMaxChunks = (kIndexMask + 1) / kChunkSize;
+
+		typedef struct
+		{
+			std::atomic<uint32_t> id;
+			std::atomic<uint32_t> next;
+			uint32_t generation;
+			T value;
+		}slot_t;
+	public:
+		SlotTable()
+		{
+			for (auto& chunk : chunks_)
+				chunk.store(nullptr, std::memory_order_relaxed);
+		}
+
+		~SlotTable()
+		{
+			for (auto& chunk : chunks_)
+				delete[] chunk.load(std::memory_order_relaxed);
+		}
+
+		SlotTable(const SlotTable&) = delete;
+		SlotTable& operator=(const SlotTable&) = delete;
+
+		// Reserves a slot, lets init(id, value) fill it in and then publishes it.
+		// Returns 0 when all 65536 slots are in use.
+		template<typename F>
+		int emplace(F&& init)
+		{
+			uint32_t index;
+			if (!pop(index) && !grow(index))
+				return 0;
+
+			slot_t& s = slot(index);
+			s.generation = (s.generation % kGenerationMask) + 1;
+			uint32_t id = (s.generation << kIndexBits) | index;
+
+			init(int(id), s.value);
+			size_.fetch_add(1, std::memory_order_relaxed);
+			s.id.store(id, std::memory_order_release);
+			return int(id);
+		}
+
+		// Removes the entry published under id and moves its value to out.
+		// Exactly one caller wins for a given id.
+		bool take(int id, T& out)
+		{
+			uint32_t uid = uint32_t(id);
+			uint32_t index = uid & kIndexMask;
+			if (id <= 0 || !(uid >> kIndexBits))
+				return false;
+
+			slot_t* chunk = chunks_[index >> kChunkBits].load(std::memory_order_acquire);
+			if (!chunk)
+				return false;
+
+			slot_t& s = chunk[index & (kChunkSize - 1)];
+			if (!s.id.compare_exchange_strong(uid, 0, std::memory_order_acq_rel))
+				return false;
+
+			out = std::move(s.value);
+			s.value = T();
+			size_.fetch_sub(1, std::memory_order_relaxed);
+			push(index);
+			return true;
+		}
+
+		// Takes every published entry and hands it to f(id, value).
+		template<typename F>
+		void drain(F&& f)
+		{
+			uint32_t chunks = chunks_count_.load(std::memory_order_acquire);
+			for (uint32_t index = 0; index < chunks * kChunkSize; ++index)
+			{
+				T value;
+				uint32_t id = slot(index).id.load(std::memory_order_acquire);
+				if (id && take(int(id), value))
+					f(int(id), value);
+			}
+		}
+
+		size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+	protected:
+		slot_t& slot(uint32_t index)
+		{
+			return chunks_[index >> kChunkBits].load(std::memory_order_acquire)[index & (kChunkSize - 1)];
+		}
+
+		void push(uint32_t index)
+		{
+			uint64_t head = head_.load(std::memory_order_relaxed);
+			uint64_t next;
+			do
+			{
+				slot(index).next.store(uint32_t(head), std::memory_order_relaxed);
+				next = (((head >> 32) + 1) << 32) | (index + 1);
+			} while (!head_.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+		}
+
+		bool pop(uint32_t& index)
+		{
+			uint64_t head = head_.load(std::memory_order_acquire);
+			uint64_t next;
+			do
+			{
+				if (!uint32_t(head))
+					return false;
+				index = uint32_t(head) - 1;
+				next = (((head >> 32) + 1) << 32) | slot(index).next.load(std::memory_order_relaxed);
+			} while (!head_.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire));
+			return true;
+		}
+
+		bool grow(uint32_t& index)
+		{
+			std::lock_guard<std::mutex> lk(mtx_grow_);
+			// another thread may have grown the table while we waited
+			if (pop(index))
+				return true;
+
+			uint32_t chunks = chunks_count_.load(std::memory_order_relaxed);
+			if (chunks == kMaxChunks)
+				return false;
+
+			slot_t* chunk = new slot_t[kChunkSize];
+			for (uint32_t i = 0; i < kChunkSize; ++i)
+			{
+				chunk[i].id.store(0, std::memory_order_relaxed);
+				chunk[i].next.store(0, std::memory_order_relaxed);
+				chunk[i].generation = 0;
+			}
+			chunks_[chunks].store(chunk, std::memory_order_release);
+			chunks_count_.store(chunks + 1, std::memory_order_release);
+
+			index = chunks * kChunkSize;
+			for (uint32_t i = kChunkSize - 1; i > 0; --i)
+				push(index + i);
+			return true;
+		}
+
+	private:
+		std::atomic<slot_t*> chunks_[kMaxChunks];
+		std::atomic<uint32_t> chunks_count_{ 0 };
+		// (ABA tag << 32) | (index + 1), 0 means empty
+		std::atomic<uint64_t> head_{ 0 };
+		std::atomic<size_t> size_{ 0 };
+		std::mutex mtx_grow_;
+	};
+}
+
+#endif	// CHAI51_SLOT_TABLE
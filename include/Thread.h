@@ -0,0 +1,13 @@
+#ifndef CHAI51_THREAD
+#define CHAI51_THREAD
+
+#include <thread>
+
+namespace protoo
+{
+	// Joins thread if joinable, or detaches it when called on thread itself,
+	// as when the last owner is released from one of its own tasks.
+	void joinThread(std::thread& thread);
+}
+
+#endif	// CHAI51_THREAD
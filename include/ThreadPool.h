@@ -0,0 +1,39 @@
+#ifndef CHAI51_THREAD_POOL
+#define CHAI51_THREAD_POOL
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace protoo
+{
+	// Fixed set of threads draining a shared FIFO of tasks.
+	class ThreadPool
+	{
+	public:
+		typedef std::function<void(void)> task;
+
+		ThreadPool(size_t threads);
+		~ThreadPool();
+
+		void post(task t);
+		// Discards queued tasks and joins the threads.
+		void stop();
+		size_t threads() const { return threads_.size(); }
+
+	protected:
+		void run();
+
+	private:
+		bool stopped_{ false };
+		std::deque<task> tasks_;
+		std::mutex mtx_;
+		std::condition_variable cond_;
+		std::vector<std::thread> threads_;
+	};
+}
+
+#endif	// CHAI51_THREAD_POOL
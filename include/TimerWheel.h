@@ -0,0 +1,75 @@
+#ifndef CHAI51_TIMER_WHEEL
+#define CHAI51_TIMER_WHEEL
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+namespace protoo
+{
+	// Hashed timing wheel. Arming and cancelling are O(1); the worker thread
+	// sleeps until the next occupied slot and expires every due timer at once.
+	// Constructed with an io_context it uses a steady_timer on a strand of that
+	// context instead of a thread, and must then be owned by a shared_ptr.
+	class TimerWheel : public std::enable_shared_from_this<TimerWheel>
+	{
+	public:
+		typedef uint64_t timer_id;
+		typedef std::function<void(void)> timer_handler;
+		typedef std::chrono::steady_clock clock;
+
+		TimerWheel(clock::duration tick = std::chrono::milliseconds(10), size_t slots = 512);
+		TimerWheel(boost::asio::io_context& ioc, clock::duration tick = std::chrono::milliseconds(10), size_t slots = 512);
+		~TimerWheel();
+
+		timer_id schedule(clock::duration timeout, timer_handler h);
+		bool cancel(timer_id id);
+		void stop();
+		size_t size();
+
+	protected:
+		void run();
+		void wake();
+		void onExpire();
+		void arm();
+		uint64_t tickOf(clock::time_point t) const;
+		void expire(uint64_t now, std::vector<timer_handler>& due);
+		uint64_t nextTick() const;
+
+		typedef struct
+		{
+			timer_id id;
+			uint64_t tick;
+			timer_handler handler;
+		}entry_t;
+	private:
+		const clock::duration tick_;
+		const clock::time_point start_;
+		std::vector<std::list<entry_t>> slots_;
+		std::unordered_map<timer_id, std::list<entry_t>::iterator> entries_;
+		uint64_t current_{ 0 };
+		uint64_t wakeup_{ UINT64_MAX };
+		timer_id next_id_{ 1 };
+		bool stopped_{ false };
+
+		std::mutex mtx_;
+		std::condition_variable cond_;
+		std::thread thread_;
+
+		std::unique_ptr<boost::asio::io_context::strand> strand_;
+		std::unique_ptr<boost::asio::steady_timer> timer_;
+	};
+}
+
+#endif	// CHAI51_TIMER_WHEEL
@@ -1,7 +1,12 @@
 #ifndef CHAI51_WEB_SOCKET_TRANSPORT
 #define CHAI51_WEB_SOCKET_TRANSPORT
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <websocketpp/client.hpp>
 #include <websocketpp/config/asio_client.hpp>
 #include <websocketpp/config/asio.hpp>
@@ -12,6 +17,10 @@
 #include <boost/log/trivial.hpp>
 
 #include "json.hpp"
+#include "MpscQueue.h"
+#include "ChunkPool.h"
+#include "JsonPushParser.h"
+#include "Message.h"
 
 #define PROTOO_LOG_TRACE(logger) std::cout << __FUNCTION__
 #define PROTOO_LOG_DEBUG(logger) std::cout << __FUNCTION__
@@ -22,39 +31,211 @@
 
 namespace protoo
 {
+	typedef struct
+	{
+		// messages sent within this long of the first unwritten one go out in
+		// one write; zero writes every message as soon as possible
+		std::chrono::microseconds window{ 0 };
+		// ... or as soon as this many bytes are waiting
+		size_t bytes{ 16 * 1024 };
+		// never wait longer than 1/8 of the smoothed request round trip time
+		bool auto_tune{ true };
+	}cork_options;
+
+	// Whether several protoo messages may travel as one JSON array per frame.
+	enum class BatchMode
+	{
+		off,
+		negotiate,	// offer the "protoo-batch" subprotocol, batch if the server selects it
+		on			// the server is known to accept arrays
+	};
+
+	typedef struct
+	{
+		// larger priority messages are sent as bulk
+		size_t priority_max{ 16 * 1024 };
+		// bulk bytes allowed ahead of a priority message in websocketpp's queue
+		size_t bulk_window{ 64 * 1024 };
+		// one waiting bulk message goes after this many priority ones
+		uint32_t priority_burst{ 8 };
+		// unsent bytes the kernel may hold (TCP_NOTSENT_LOWAT, Linux and macOS);
+		// zero leaves the socket alone
+		size_t notsent_lowat{ 128 * 1024 };
+	}lane_options;
+
+	// Outbound lanes: Peer sends responses and requests as priority,
+	// notifications as bulk. Order is kept within a lane, not across lanes.
+	enum class SendLane
+	{
+		priority,
+		bulk
+	};
+
+	// What Peer::notify does while the send buffer is above the high water mark.
+	enum class BackpressurePolicy
+	{
+		none,	// send anyway
+		fail,	// throw
+		block	// wait for the buffer to drain below the low mark; fails on the io thread
+	};
+
 	class WebSocketTransport
 	{
 		friend class Peer;
 		typedef websocketpp::client<websocketpp::config::asio_tls_client> client;
 		typedef websocketpp::lib::shared_ptr<websocketpp::lib::asio::ssl::context> context_ptr;
 	public:
+		// Runs the connection on a private io_context thread.
 		WebSocketTransport(const std::string& url, void* options);
+		// Runs the connection on ioc and creates no threads of its own. ioc
+		// must outlive the transport.
+		WebSocketTransport(const std::string& url, void* options, boost::asio::io_context& ioc);
+		~WebSocketTransport();
 
 		void close();
-		void send(const nlohmann::json& message);
+		// Thread-safe. The message is serialized on the calling thread; off the
+		// io thread it is queued and written there, in order per caller and lane.
+		void send(const nlohmann::json& message, SendLane lane = SendLane::bulk);
+		// As above, with data, already serialized JSON, spliced into the
+		// envelope object as its "data" member without being parsed; left out
+		// when data is empty.
+		void send(const nlohmann::json& envelope, boost::string_view data, SendLane lane = SendLane::bulk);
+
+		boost::asio::io_context& get_io_context() { return *ioc_; }
+		// Must be called before the transport is handed to a Peer, which starts
+		// connecting.
+		void set_cork(const cork_options& options) { cork_ = options; }
+		// the window currently in effect, after auto-tuning
+		std::chrono::microseconds get_cork_window() const;
+		// Must be called before the transport is handed to a Peer.
+		void set_batch_mode(BatchMode mode) { batch_mode_ = mode; }
+		// true once connected with batching enabled
+		bool batching() const { return batching_; }
+		// Bytes passed to send() and not yet written to the socket.
+		size_t get_buffered_amount() const { return buffered_; }
+		// Must be called before the transport is handed to a Peer. The high water
+		// handler runs once the buffered amount reaches high, the low water
+		// handler once it has fallen back to low.
+		void set_watermarks(size_t high, size_t low) { high_ = high; low_ = low; }
+		// Must be called before the transport is handed to a Peer, which keeps
+		// them and runs its own handlers after them. High runs on the thread
+		// that crossed the mark in send(), low on the io thread.
+		void set_high_water_handler(std::function<void(void)> h) { high_water_handler_ = std::move(h); }
+		void set_low_water_handler(std::function<void(void)> h) { low_water_handler_ = std::move(h); }
+		// Must be called before the transport is handed to a Peer.
+		void set_lanes(const lane_options& options) { lanes_ = options; }
+		// Must be called before the transport is handed to a Peer. Messages are
+		// serialized into chunks of at most bytes and larger ones sent as one
+		// fragment per chunk, so pings and pongs need not wait for the whole
+		// message; zero disables.
+		void set_fragment_size(size_t bytes) { fragment_size_ = bytes; }
+		// Must be called before the transport is handed to a Peer. Parses
+		// inbound messages as their frames arrive rather than once complete,
+		// without keeping the text, and leaves data unparsed until a handler
+		// asks for it. On by default; off uses json::parse on the whole message.
+		void set_incremental_parse(bool enabled) { incremental_ = enabled; }
 
 	protected:
-		void runWebSocket();
+		void init();
+		void start();
+		void connect();
+		void reconnect();
+		void post(void (WebSocketTransport::*f)());
+		void armCork();
+		void flushQueued();
+		void enqueue(chunked_t&& payload, SendLane lane);
+		// all ignores bulk_window
+		void flush(bool all = false);
+		bool writeBulk(bool force);
+		// may take payload's contents
+		void write(chunked_t& payload);
+		bool writeFragments(bool all);
+		void writeFrame(std::string& chunk, websocketpp::frame::opcode::value op, bool fin);
+		void dropWrites();
+		void buffered(size_t size);
+		void drained(size_t size);
+		void wakeWriters();
+		// false if policy says the caller may not send now
+		bool admit(BackpressurePolicy policy);
+
+		// fed by Peer with request round trip times
+		void observeRtt(std::chrono::steady_clock::duration rtt);
 
 		void onMessage(websocketpp::connection_hdl hdl, client::message_ptr msg);
 		void onOpen(websocketpp::connection_hdl hdl);
 		void onClose(websocketpp::connection_hdl hdl);
 		void onFail(websocketpp::connection_hdl hdl);
+		void onWritten(size_t size);
+		// Drops the owner's handlers; none is called once this returns.
+		void detach();
 		context_ptr onTlsInit(const char* hostname, websocketpp::connection_hdl);
 
 		static bool verify_certificate(const char* hostname, bool preverified, boost::asio::ssl::verify_context& ctx);
 		static bool verify_subject_alternative_name(const char* hostname, X509* cert);
 		static bool verify_common_name(char const* hostname, X509* cert);
+
+		// websocketpp handlers hold the guard rather than this, so callbacks
+		// still queued on an external io_context are dropped once we are gone
+		typedef struct
+		{
+			std::recursive_mutex mtx;
+			WebSocketTransport* self;
+			// the open connection, kept here so a posted close outlives us
+			websocketpp::connection_hdl ws;
+		}guard_t;
 	private:
-		bool closed_{ false };
+		std::atomic<bool> closed_{ false };
+		std::atomic<bool> open_{ false };
 		bool wasConnected_{ false };
 		std::string url_;
+		std::string host_;
 		std::string err_;
 
-		std::unique_ptr<client> endpoint_;
-		websocketpp::connection_hdl ws_;
+		std::unique_ptr<boost::asio::io_context> own_ioc_;
+		boost::asio::io_context* ioc_;
+		std::unique_ptr<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work_;
+		std::shared_ptr<guard_t> guard_;
+
+		// shared with the connections, see connect()
+		std::shared_ptr<client> endpoint_;
+		std::unique_ptr<boost::asio::steady_timer> retry_timer_;
 		std::unique_ptr<std::thread> thread_;
+		// serialized messages from other threads, drained by flush() on the io
+		// thread; scheduled_ is set while a flush is posted
+		MpscQueue<chunked_t> priority_lane_;
+		MpscQueue<chunked_t> bulk_lane_;
+		lane_options lanes_;
+		// a bulk message taken off bulk_lane_ and waiting for bulk_window
+		chunked_t held_;
+		bool holding_{ false };
+		uint32_t priority_run_{ 0 };
+		size_t fragment_size_{ 64 * 1024 };
+		// messages are serialized into chunks of fragment_size_
+		std::unique_ptr<ChunkPool> chunks_;
+		// the message being sent in fragments, and the next one to go
+		chunked_t fragmented_;
+		size_t fragment_{ 0 };
+		bool incremental_{ true };
+		JsonPushParser parser_;
+		std::atomic<bool> scheduled_{ false };
+		cork_options cork_;
+		std::unique_ptr<boost::asio::steady_timer> cork_timer_;
+		std::atomic<size_t> queued_bytes_{ 0 };
+		std::atomic<bool> urgent_{ false };
+		std::atomic<int64_t> srtt_{ 0 };
+		BatchMode batch_mode_{ BatchMode::off };
+		std::atomic<bool> batching_{ false };
+		// buffered_ counts from send() until written, written_ the part of it
+		// handed to websocketpp, which is lost with the connection
+		std::atomic<size_t> buffered_{ 0 };
+		std::atomic<size_t> written_{ 0 };
+		size_t high_{ 1024 * 1024 };
+		size_t low_{ 256 * 1024 };
+		std::atomic<bool> above_{ false };
+		std::mutex water_mtx_;
+		std::condition_variable water_cond_;
 		uint32_t currentAttempt_{ 0 };
+		uint32_t retries_{ 0 };
 
 		std::shared_ptr<client::alog_type> m_alog;
 		std::shared_ptr<client::elog_type> m_elog;
@@ -63,7 +244,9 @@ namespace protoo
 		std::function<void(void)> disconnected_handler_;
 		std::function<void(void)> close_handler_;
 		std::function<void(int)> failed_handler_;
-		std::function<void(const nlohmann::json&)> message_handler_;
+		std::function<void(Message&&)> message_handler_;
+		std::function<void(void)> high_water_handler_;
+		std::function<void(void)> low_water_handler_;
 	};
 }
 
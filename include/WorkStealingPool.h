@@ -0,0 +1,54 @@
+#ifndef CHAI51_WORK_STEALING_POOL
+#define CHAI51_WORK_STEALING_POOL
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace protoo
+{
+	// Threads with a task deque each. A task posted from a worker goes to that
+	// worker's own deque and is run newest first while still cache-hot; tasks
+	// from outside are spread round-robin. Idle workers steal the oldest task
+	// from the others before parking.
+	class WorkStealingPool
+	{
+	public:
+		typedef std::function<void(void)> task;
+
+		WorkStealingPool(size_t threads);
+		~WorkStealingPool();
+
+		void post(task t);
+		// Discards queued tasks and joins the threads.
+		void stop();
+		size_t threads() const { return threads_.size(); }
+
+	protected:
+		typedef struct
+		{
+			std::mutex mtx;
+			std::deque<task> tasks;
+		}worker_t;
+
+		void run(size_t index);
+		bool take(size_t index, task& t);
+
+	private:
+		std::vector<std::unique_ptr<worker_t>> workers_;
+		std::vector<std::thread> threads_;
+		std::atomic<size_t> pending_{ 0 };
+		std::atomic<size_t> idle_{ 0 };
+		std::atomic<size_t> next_{ 0 };
+		std::atomic<bool> stopped_{ false };
+		std::mutex mtx_;
+		std::condition_variable cond_;
+	};
+}
+
+#endif	// CHAI51_WORK_STEALING_POOL
@@ -0,0 +1,141 @@
+#include "ChunkPool.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace protoo
+{
+	ChunkPool::ChunkPool(size_t chunkSize, size_t maxIdle)
+		: chunk_size_(chunkSize ? std::max<size_t>(chunkSize, 16) : std::numeric_limits<size_t>::max())
+		, max_idle_(chunkSize ? maxIdle : 0)
+	{
+	}
+
+	void ChunkPool::dump(const nlohmann::json& message, chunked_t& out)
+	{
+		begin(out);
+		nlohmann::detail::serializer<nlohmann::json> serializer(std::make_shared<writer_t>(*this, out), ' ');
+		serializer.dump(message, false, false, 0);
+		end(out);
+	}
+
+	void ChunkPool::dump(const nlohmann::json& message, const std::string& key, boost::string_view raw, chunked_t& out)
+	{
+		if (!message.is_object())
+			throw std::invalid_argument("message is not an object");
+		if (raw.empty())
+		{
+			dump(message, out);
+			return;
+		}
+
+		begin(out);
+		auto writer = std::make_shared<writer_t>(*this, out);
+		nlohmann::detail::serializer<nlohmann::json> serializer(writer, ' ');
+		serializer.dump(message, false, false, 0);
+
+		// reopen the object by dropping its closing brace
+		end(out);
+		out.chunks.back().pop_back();
+		out.size--;
+		if (!message.empty())
+			writer->write_character(',');
+		serializer.dump(key, false, false, 0);
+		writer->write_character(':');
+		writer->write_characters(raw.data(), raw.size());
+		writer->write_character('}');
+		end(out);
+	}
+
+	void ChunkPool::begin(chunked_t& out)
+	{
+		out.chunks.clear();
+		out.size = 0;
+		// the first chunk grows as needed, so small messages do not pin a
+		// full-size buffer while they wait to be written
+		out.chunks.emplace_back();
+	}
+
+	void ChunkPool::end(chunked_t& out)
+	{
+		if (out.chunks.size() > 1 && out.chunks.back().empty())
+		{
+			put(std::move(out.chunks.back()));
+			out.chunks.pop_back();
+		}
+	}
+
+	void ChunkPool::put(std::string&& chunk)
+	{
+		if (chunk.capacity() < chunk_size_ || chunk.capacity() > 2 * chunk_size_)
+			return;
+		chunk.clear();
+		std::lock_guard<std::mutex> lk(mtx_);
+		if (idle_.size() < max_idle_)
+			idle_.push_back(std::move(chunk));
+	}
+
+	std::string ChunkPool::get()
+	{
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			if (!idle_.empty())
+			{
+				std::string chunk = std::move(idle_.back());
+				idle_.pop_back();
+				return chunk;
+			}
+		}
+		std::string chunk;
+		chunk.reserve(chunk_size_);
+		return chunk;
+	}
+
+	ChunkPool::writer_t::writer_t(ChunkPool& pool, chunked_t& out)
+		: pool_(pool)
+		, out_(out)
+	{
+	}
+
+	void ChunkPool::writer_t::write_character(char c)
+	{
+		write_characters(&c, 1);
+	}
+
+	void ChunkPool::writer_t::write_characters(const char* s, std::size_t length)
+	{
+		out_.size += length;
+		while (length)
+		{
+			std::string& chunk = out_.chunks.back();
+			size_t n = std::min(length, pool_.chunk_size_ - chunk.size());
+			chunk.append(s, n);
+			s += n;
+			length -= n;
+			if (chunk.size() == pool_.chunk_size_)
+				seal();
+		}
+	}
+
+	void ChunkPool::writer_t::seal()
+	{
+		// move a trailing partial UTF-8 sequence on to the next chunk
+		std::string& chunk = out_.chunks.back();
+		size_t lead = chunk.size();
+		while (lead > 0 && chunk.size() - lead < 4 && (uint8_t(chunk[lead - 1]) & 0xC0) == 0x80)
+			--lead;
+		size_t tail = chunk.size();
+		if (lead > 0)
+		{
+			uint8_t c = uint8_t(chunk[lead - 1]);
+			size_t length = c < 0x80 ? 1 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+			if (lead - 1 + length > chunk.size())
+				tail = lead - 1;
+		}
+
+		std::string next = pool_.get();
+		next.append(chunk, tail, std::string::npos);
+		chunk.resize(tail);
+		out_.chunks.push_back(std::move(next));
+	}
+}
@@ -0,0 +1,27 @@
+#include "Executor.h"
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/post.hpp>
+
+namespace protoo
+{
+	executor inlineExecutor()
+	{
+		return [](std::function<void(void)> task) { task(); };
+	}
+
+	executor strandExecutor(boost::asio::io_context& ioc)
+	{
+		auto strand = std::make_shared<boost::asio::io_context::strand>(ioc);
+		return [strand](std::function<void(void)> task) { boost::asio::post(*strand, std::move(task)); };
+	}
+
+	executor poolExecutor(std::shared_ptr<ThreadPool> pool)
+	{
+		return [pool](std::function<void(void)> task) { pool->post(std::move(task)); };
+	}
+
+	executor stealingExecutor(std::shared_ptr<WorkStealingPool> pool)
+	{
+		return [pool](std::function<void(void)> task) { pool->post(std::move(task)); };
+	}
+}
@@ -0,0 +1,52 @@
+#include "Histogram.h"
+
+namespace protoo
+{
+	Histogram::Histogram()
+	{
+		for (auto& bucket : buckets_)
+			bucket.store(0, std::memory_order_relaxed);
+	}
+
+	void Histogram::record(std::chrono::steady_clock::duration d)
+	{
+		int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+		uint64_t value = us > 0 ? uint64_t(us) : 0;
+
+		size_t bucket = 0;
+		while (value >> bucket && bucket < kBuckets - 1)
+			++bucket;
+
+		buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+		count_.fetch_add(1, std::memory_order_relaxed);
+		sum_.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	uint64_t Histogram::percentile(double p) const
+	{
+		uint64_t total = count();
+		if (!total)
+			return 0;
+
+		uint64_t rank = uint64_t(p / 100.0 * total + 0.5);
+		if (rank == 0)
+			rank = 1;
+
+		uint64_t seen = 0;
+		for (size_t i = 0; i < kBuckets; ++i)
+		{
+			seen += buckets_[i].load(std::memory_order_relaxed);
+			if (seen >= rank)
+				return uint64_t(1) << i;
+		}
+		return uint64_t(1) << (kBuckets - 1);
+	}
+
+	std::vector<uint64_t> Histogram::buckets() const
+	{
+		std::vector<uint64_t> buckets;
+		for (auto& bucket : buckets_)
+			buckets.push_back(bucket.load(std::memory_order_relaxed));
+		return buckets;
+	}
+}
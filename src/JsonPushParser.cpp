@@ -0,0 +1,536 @@
+#include "JsonPushParser.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace protoo
+{
+	namespace
+	{
+		bool isSpace(char c)
+		{
+			return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+		}
+
+		bool isNumberChar(char c)
+		{
+			return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+		}
+
+		void appendUtf8(std::string& out, uint32_t cp)
+		{
+			if (cp < 0x80)
+			{
+				out += char(cp);
+			}
+			else if (cp < 0x800)
+			{
+				out += char(0xC0 | (cp >> 6));
+				out += char(0x80 | (cp & 0x3F));
+			}
+			else if (cp < 0x10000)
+			{
+				out += char(0xE0 | (cp >> 12));
+				out += char(0x80 | ((cp >> 6) & 0x3F));
+				out += char(0x80 | (cp & 0x3F));
+			}
+			else
+			{
+				out += char(0xF0 | (cp >> 18));
+				out += char(0x80 | ((cp >> 12) & 0x3F));
+				out += char(0x80 | ((cp >> 6) & 0x3F));
+				out += char(0x80 | (cp & 0x3F));
+			}
+		}
+
+		// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+		bool validNumber(const std::string& s, bool& integer)
+		{
+			size_t i = 0, n = s.size();
+			auto digits = [&]()
+			{
+				size_t start = i;
+				while (i < n && s[i] >= '0' && s[i] <= '9')
+					++i;
+				return i > start;
+			};
+
+			integer = true;
+			if (i < n && s[i] == '-')
+				++i;
+			if (i < n && s[i] == '0')
+				++i;
+			else if (!digits())
+				return false;
+			if (i < n && s[i] == '.')
+			{
+				integer = false;
+				++i;
+				if (!digits())
+					return false;
+			}
+			if (i < n && (s[i] == 'e' || s[i] == 'E'))
+			{
+				integer = false;
+				++i;
+				if (i < n && (s[i] == '+' || s[i] == '-'))
+					++i;
+				if (!digits())
+					return false;
+			}
+			return i == n;
+		}
+	}
+
+	JsonPushParser::JsonPushParser()
+	{
+		reset();
+	}
+
+	void JsonPushParser::reset()
+	{
+		state_ = state_t::value;
+		root_ = nullptr;
+		stack_.clear();
+		text_.clear();
+		token_.clear();
+		high_surrogate_ = 0;
+		first_ = false;
+		error_.clear();
+		raw_.clear();
+	}
+
+	nlohmann::json JsonPushParser::finish(std::string* raw)
+	{
+		if (raw)
+			raw->clear();
+		if (state_ == state_t::number)
+			endNumber();
+		if (state_ != state_t::done && state_ != state_t::failed)
+			fail("unexpected end of input");
+
+		if (state_ == state_t::failed)
+		{
+			std::string error = error_;
+			reset();
+			throw std::invalid_argument(error);
+		}
+
+		nlohmann::json value = std::move(root_);
+		if (raw)
+			raw->swap(raw_);
+		reset();
+		return value;
+	}
+
+	void JsonPushParser::feed(const char* data, size_t size)
+	{
+		const char* p = data;
+		const char* end = data + size;
+		while (p < end && state_ != state_t::failed)
+		{
+			char c = *p;
+			switch (state_)
+			{
+			case state_t::string:
+				p += parseString(p, end);
+				continue;
+
+			case state_t::raw:
+				p += parseRaw(p, end);
+				continue;
+
+			case state_t::escape:
+				parseEscape(c);
+				break;
+
+			case state_t::unicode:
+				parseUnicode(c);
+				break;
+
+			case state_t::number:
+				if (isNumberChar(c))
+				{
+					token_ += c;
+					break;
+				}
+				// c belongs to whatever follows the number
+				endNumber();
+				continue;
+
+			case state_t::literal:
+				if (c != literal_[token_.size()])
+				{
+					fail("invalid literal");
+					break;
+				}
+				token_ += c;
+				if (!literal_[token_.size()])
+				{
+					if (literal_[0] == 't')
+						beginValue(true);
+					else if (literal_[0] == 'f')
+						beginValue(false);
+					else
+						beginValue(nullptr);
+				}
+				break;
+
+			case state_t::value:
+				if (isSpace(c))
+					break;
+				if (stack_.size() == 1 && !raw_member_.empty() && stack_.back().value->is_object()
+					&& stack_.back().key == raw_member_)
+				{
+					raw_.clear();
+					raw_depth_ = 0;
+					raw_string_ = false;
+					raw_escape_ = false;
+					state_ = state_t::raw;
+					continue;
+				}
+				if (c == ']' && first_ && !stack_.empty() && stack_.back().value->is_array())
+				{
+					stack_.pop_back();
+					endValue();
+				}
+				else if (c == '"')
+				{
+					text_.clear();
+					is_key_ = false;
+					state_ = state_t::string;
+				}
+				else if (c == '{')
+				{
+					beginValue(nlohmann::json::object());
+				}
+				else if (c == '[')
+				{
+					beginValue(nlohmann::json::array());
+				}
+				else if (c == '-' || (c >= '0' && c <= '9'))
+				{
+					token_.assign(1, c);
+					state_ = state_t::number;
+				}
+				else if (c == 't' || c == 'f' || c == 'n')
+				{
+					literal_ = c == 't' ? "true" : c == 'f' ? "false" : "null";
+					token_.assign(1, c);
+					state_ = state_t::literal;
+				}
+				else
+				{
+					fail("unexpected character, expected a value");
+				}
+				break;
+
+			case state_t::key:
+				if (isSpace(c))
+					break;
+				if (c == '}' && first_)
+				{
+					stack_.pop_back();
+					endValue();
+				}
+				else if (c == '"')
+				{
+					text_.clear();
+					is_key_ = true;
+					state_ = state_t::string;
+				}
+				else
+				{
+					fail("unexpected character, expected an object key");
+				}
+				break;
+
+			case state_t::colon:
+				if (isSpace(c))
+					break;
+				if (c == ':')
+					state_ = state_t::value;
+				else
+					fail("unexpected character, expected ':'");
+				break;
+
+			case state_t::after_value:
+				if (isSpace(c))
+					break;
+				if (c == ',')
+				{
+					first_ = false;
+					state_ = stack_.back().value->is_object() ? state_t::key : state_t::value;
+				}
+				else if (c == (stack_.back().value->is_object() ? '}' : ']'))
+				{
+					stack_.pop_back();
+					endValue();
+				}
+				else
+				{
+					fail("unexpected character, expected ',' or a closing bracket");
+				}
+				break;
+
+			case state_t::done:
+				if (!isSpace(c))
+					fail("unexpected character after the value");
+				break;
+
+			case state_t::failed:
+				break;
+			}
+			++p;
+		}
+	}
+
+	size_t JsonPushParser::parseString(const char* p, const char* end)
+	{
+		if (high_surrogate_ && *p != '\\')
+		{
+			fail("missing low surrogate");
+			return 1;
+		}
+
+		const char* q = p;
+		while (q < end && *q != '"' && *q != '\\' && uint8_t(*q) >= 0x20)
+			++q;
+		text_.append(p, q);
+		if (q == end)
+			return q - p;
+
+		if (*q == '\\')
+		{
+			state_ = state_t::escape;
+		}
+		else if (*q == '"')
+		{
+			if (is_key_)
+			{
+				stack_.back().key = std::move(text_);
+				state_ = state_t::colon;
+			}
+			else
+			{
+				beginValue(nlohmann::json(std::move(text_)));
+			}
+			text_.clear();
+		}
+		else
+		{
+			fail("control character in string");
+		}
+		return q - p + 1;
+	}
+
+	size_t JsonPushParser::parseRaw(const char* p, const char* end)
+	{
+		// only strings and brackets matter for finding where the value ends
+		const char* q = p;
+		for (; q < end; ++q)
+		{
+			char c = *q;
+			if (raw_string_)
+			{
+				if (raw_escape_)
+					raw_escape_ = false;
+				else if (c == '\\')
+					raw_escape_ = true;
+				else if (c == '"')
+					raw_string_ = false;
+			}
+			else if (c == '"')
+			{
+				raw_string_ = true;
+			}
+			else if (c == '{' || c == '[')
+			{
+				++raw_depth_;
+			}
+			else if (c == '}' || c == ']')
+			{
+				if (!raw_depth_)
+					break;
+				--raw_depth_;
+			}
+			else if (c == ',' && !raw_depth_)
+			{
+				break;
+			}
+		}
+		raw_.append(p, q);
+		if (q == end)
+			return q - p;
+
+		// *q belongs to the enclosing object
+		while (!raw_.empty() && isSpace(raw_.back()))
+			raw_.pop_back();
+		if (raw_.empty())
+			fail("unexpected character, expected a value");
+		else
+			endValue();
+		return q - p;
+	}
+
+	void JsonPushParser::parseEscape(char c)
+	{
+		if (high_surrogate_ && c != 'u')
+		{
+			fail("missing low surrogate");
+			return;
+		}
+
+		state_ = state_t::string;
+		switch (c)
+		{
+		case '"': text_ += '"'; break;
+		case '\\': text_ += '\\'; break;
+		case '/': text_ += '/'; break;
+		case 'b': text_ += '\b'; break;
+		case 'f': text_ += '\f'; break;
+		case 'n': text_ += '\n'; break;
+		case 'r': text_ += '\r'; break;
+		case 't': text_ += '\t'; break;
+		case 'u':
+			code_ = 0;
+			hex_digits_ = 0;
+			state_ = state_t::unicode;
+			break;
+		default:
+			fail("invalid escape");
+			return;
+		}
+	}
+
+	void JsonPushParser::parseUnicode(char c)
+	{
+		uint32_t digit;
+		if (c >= '0' && c <= '9')
+			digit = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			digit = c - 'A' + 10;
+		else
+		{
+			fail("invalid \\u escape");
+			return;
+		}
+
+		code_ = (code_ << 4) | digit;
+		if (++hex_digits_ < 4)
+			return;
+
+		state_ = state_t::string;
+		if (high_surrogate_)
+		{
+			if (code_ < 0xDC00 || code_ > 0xDFFF)
+			{
+				fail("invalid low surrogate");
+				return;
+			}
+			appendUtf8(text_, 0x10000 + ((high_surrogate_ - 0xD800) << 10) + (code_ - 0xDC00));
+			high_surrogate_ = 0;
+		}
+		else if (code_ >= 0xD800 && code_ <= 0xDBFF)
+		{
+			high_surrogate_ = code_;
+		}
+		else if (code_ >= 0xDC00 && code_ <= 0xDFFF)
+		{
+			fail("unexpected low surrogate");
+			return;
+		}
+		else
+		{
+			appendUtf8(text_, code_);
+		}
+	}
+
+	void JsonPushParser::endNumber()
+	{
+		bool integer;
+		if (!validNumber(token_, integer))
+		{
+			fail("invalid number");
+			return;
+		}
+
+		// as nlohmann: integers that fit stay integers, the rest become doubles
+		const char* s = token_.c_str();
+		char* end = nullptr;
+		if (integer)
+		{
+			errno = 0;
+			if (*s == '-')
+			{
+				long long value = std::strtoll(s, &end, 10);
+				if (errno == 0)
+				{
+					beginValue(nlohmann::json::number_integer_t(value));
+					return;
+				}
+			}
+			else
+			{
+				unsigned long long value = std::strtoull(s, &end, 10);
+				if (errno == 0)
+				{
+					beginValue(nlohmann::json::number_unsigned_t(value));
+					return;
+				}
+			}
+		}
+		// as nlohmann: overflow is an error, underflow rounds toward zero
+		double value = std::strtod(s, &end);
+		if (!std::isfinite(value))
+		{
+			fail("number overflow");
+			return;
+		}
+		beginValue(nlohmann::json::number_float_t(value));
+	}
+
+	void JsonPushParser::beginValue(nlohmann::json&& value)
+	{
+		nlohmann::json& target = slot();
+		target = std::move(value);
+		if (target.is_structured())
+		{
+			// elements are only added to the innermost container, so target
+			// stays put while it is on the stack
+			stack_.push_back({ &target, std::string() });
+			first_ = true;
+			state_ = target.is_object() ? state_t::key : state_t::value;
+			return;
+		}
+		endValue();
+	}
+
+	void JsonPushParser::endValue()
+	{
+		first_ = false;
+		state_ = stack_.empty() ? state_t::done : state_t::after_value;
+	}
+
+	nlohmann::json& JsonPushParser::slot()
+	{
+		if (stack_.empty())
+			return root_;
+		frame_t& top = stack_.back();
+		if (top.value->is_array())
+		{
+			top.value->push_back(nullptr);
+			return top.value->back();
+		}
+		return (*top.value)[top.key];
+	}
+
+	void JsonPushParser::fail(const char* reason)
+	{
+		state_ = state_t::failed;
+		error_ = reason;
+	}
+}
@@ -0,0 +1,94 @@
+#include "Message.h"
+#include <stdexcept>
+
+namespace protoo
+{
+	using nlohmann::json;
+
+	Message::Message(json&& envelope, std::string&& rawData)
+		: envelope_(std::move(envelope))
+		, raw_(std::move(rawData))
+	{
+	}
+
+	Message::Message(json&& message)
+		: envelope_(std::move(message))
+	{
+		if (!envelope_.is_object())
+			return;
+
+		auto it = envelope_.find("data");
+		if (it == envelope_.end())
+			return;
+		data_ = std::move(*it);
+		parsed_ = true;
+		envelope_.erase(it);
+	}
+
+	bool Message::has(const char* key) const
+	{
+		return envelope_.is_object() && envelope_.find(key) != envelope_.end();
+	}
+
+	const std::string& Message::method() const
+	{
+		static const std::string none;
+		if (!envelope_.is_object())
+			return none;
+		auto it = envelope_.find("method");
+		if (it == envelope_.end() || !it->is_string())
+			return none;
+		return it->get_ref<const std::string&>();
+	}
+
+	const json& Message::id() const
+	{
+		static const json none;
+		if (!envelope_.is_object())
+			return none;
+		auto it = envelope_.find("id");
+		return it == envelope_.end() ? none : *it;
+	}
+
+	bool Message::ok() const
+	{
+		if (!envelope_.is_object())
+			return false;
+		auto it = envelope_.find("ok");
+		return it != envelope_.end() && it->is_boolean() && it->get<bool>();
+	}
+
+	const json& Message::data()
+	{
+		if (parsed_ || raw_.empty())
+			return data_;
+
+		try
+		{
+			data_ = json::parse(raw_);
+		}
+		catch (const json::parse_error& e)
+		{
+			throw std::invalid_argument(e.what());
+		}
+		parsed_ = true;
+		raw_.clear();
+		raw_.shrink_to_fit();
+		return data_;
+	}
+
+	json Message::release()
+	{
+		if (has_data())
+		{
+			data();
+			envelope_["data"] = std::move(data_);
+		}
+		json message = std::move(envelope_);
+		envelope_ = nullptr;
+		data_ = nullptr;
+		raw_.clear();
+		parsed_ = false;
+		return message;
+	}
+}
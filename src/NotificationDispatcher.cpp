@@ -0,0 +1,163 @@
+#include "NotificationDispatcher.h"
+#include "Thread.h"
+#include <algorithm>
+
+namespace protoo
+{
+	using nlohmann::json;
+
+	static const size_t kDrainBatch = 64;
+
+	NotificationDispatcher::NotificationDispatcher(dispatch_handler h, const notification_options& options)
+		: handler_(std::move(h))
+		, key_(options.key)
+	{
+		size_t workers = options.workers ? options.workers : 1;
+		for (size_t i = 0; i < workers; ++i)
+			lanes_.push_back(std::make_shared<lane_t>(options));
+		for (auto& lane : lanes_)
+			threads_.emplace_back(&NotificationDispatcher::run, this, &lane->queue);
+	}
+
+	NotificationDispatcher::NotificationDispatcher(dispatch_handler h, const notification_options& options, executor ex)
+		: handler_(std::move(h))
+		, key_(options.key)
+		, executor_(std::move(ex))
+	{
+		size_t workers = options.workers ? options.workers : 1;
+		for (size_t i = 0; i < workers; ++i)
+		{
+			auto lane = std::make_shared<lane_t>(options);
+			lane->handler = handler_;
+			lane->ex = executor_;
+
+			// a blocked producer may be the thread the drain task needs, so it
+			// drains the lane itself unless a drain task is already running
+			lane_t* raw = lane.get();
+			lane->queue.set_full_handler([raw]()
+				{
+					std::unique_lock<std::recursive_mutex> lk(raw->mtx, std::try_to_lock);
+					if (lk.owns_lock() && !raw->closed)
+						drain(*raw, kDrainBatch);
+				});
+			lanes_.push_back(lane);
+		}
+	}
+
+	NotificationDispatcher::~NotificationDispatcher()
+	{
+		close();
+	}
+
+	bool NotificationDispatcher::push(json&& message)
+	{
+		auto& lane = lanes_.size() == 1 ? lanes_[0] : lanes_[laneOf(message)];
+		if (!lane->queue.push(std::move(message)))
+			return false;
+
+		if (lane->ex && !lane->scheduled.exchange(true))
+			schedule(lane);
+		return true;
+	}
+
+	void NotificationDispatcher::close()
+	{
+		for (auto& lane : lanes_)
+		{
+			lane->queue.close();
+			if (executor_)
+			{
+				std::lock_guard<std::recursive_mutex> lk(lane->mtx);
+				lane->closed = true;
+			}
+		}
+
+		for (auto& thread : threads_)
+			joinThread(thread);
+	}
+
+	notification_stats NotificationDispatcher::stats() const
+	{
+		notification_stats total = { 0, 0, 0, 0 };
+		for (auto& lane : lanes_)
+		{
+			auto stats = lane->queue.stats();
+			total.queued += stats.queued;
+			total.dropped += stats.dropped;
+			total.coalesced += stats.coalesced;
+			total.high_water = std::max(total.high_water, stats.high_water);
+		}
+		return total;
+	}
+
+	key_extractor NotificationDispatcher::dataKey(const std::string& field)
+	{
+		return [field](const json& notification) -> std::string
+		{
+			auto data = notification.find("data");
+			if (data == notification.end() || !data->is_object())
+				return std::string();
+
+			auto value = data->find(field);
+			if (value == data->end())
+				return std::string();
+			return value->is_string() ? value->get<std::string>() : value->dump();
+		};
+	}
+
+	void NotificationDispatcher::run(NotificationQueue* queue)
+	{
+		json message;
+		while (queue->pop(message))
+		{
+			if (handler_)
+				handler_(message);
+		}
+	}
+
+	void NotificationDispatcher::schedule(const std::shared_ptr<lane_t>& lane)
+	{
+		std::shared_ptr<lane_t> owner = lane;
+		lane->ex([owner]()
+			{
+				size_t drained;
+				{
+					std::lock_guard<std::recursive_mutex> lk(owner->mtx);
+					if (owner->closed)
+						return;
+					// cleared first: a push racing with the drain below schedules again
+					owner->scheduled = false;
+					drained = drain(*owner, kDrainBatch);
+				}
+
+				// a full batch may have left more behind; yield the executor and
+				// come back instead of monopolizing it
+				if (drained == kDrainBatch && !owner->scheduled.exchange(true))
+					schedule(owner);
+			});
+	}
+
+	size_t NotificationDispatcher::drain(lane_t& lane, size_t batch)
+	{
+		json message;
+		size_t count = 0;
+		while (count < batch && lane.queue.poll(message))
+		{
+			++count;
+			if (lane.handler)
+				lane.handler(message);
+		}
+		return count;
+	}
+
+	size_t NotificationDispatcher::laneOf(const json& message) const
+	{
+		std::string key;
+		if (key_)
+			key = key_(message);
+		if (key.empty())
+			key = methodOf(message);
+
+		return std::hash<std::string>()(key) % lanes_.size();
+	}
+}
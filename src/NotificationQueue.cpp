@@ -0,0 +1,394 @@
+#include "NotificationQueue.h"
+#include <thread>
+
+namespace protoo
+{
+	using nlohmann::json;
+
+	static const int kSpinCount = 128;
+	static const int kYieldCount = 16;
+
+	const std::string& methodOf(const json& message)
+	{
+		static const std::string none;
+		if (!message.is_object())
+			return none;
+		auto it = message.find("method");
+		if (it == message.end() || !it->is_string())
+			return none;
+		return it->get_ref<const std::string&>();
+	}
+
+	NotificationQueue::NotificationQueue(size_t capacity, OverflowPolicy policy, key_extractor key,
+		coalesce_registry coalesce)
+		: policy_(policy)
+		, key_(std::move(key))
+		, coalesce_(std::move(coalesce))
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size <<= 1;
+
+		cells_.reset(new cell_t[size]);
+		mask_ = size - 1;
+		for (size_t i = 0; i < size; ++i)
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	bool NotificationQueue::push(json&& message)
+	{
+		std::shared_ptr<pending_t> pending;
+		if (closed_)
+			return false;
+
+		std::string key = coalesceKey(message);
+		if (!key.empty())
+		{
+			// registered before the ring cell becomes visible, so the consumer
+			// always finds (and unregisters) it when taking the cell
+			std::lock_guard<std::mutex> lk(mtx_pending_);
+			auto it = pending_.find(key);
+			if (it != pending_.end())
+			{
+				it->second->message = std::move(message);
+				coalesced_.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+			pending = std::make_shared<pending_t>();
+			pending->key = std::move(key);
+			pending->message = std::move(message);
+			pending_[pending->key] = pending;
+		}
+
+		auto queued = pending;
+		if (!enqueue(message, queued))
+		{
+			if (pending)
+				forget(pending);
+			return !closed_;
+		}
+
+		onQueued();
+		wakeConsumer();
+		return true;
+	}
+
+	bool NotificationQueue::pop(json& message)
+	{
+		std::shared_ptr<pending_t> pending;
+		for (int i = 0; i < kSpinCount + kYieldCount; ++i)
+		{
+			if (tryPop(message, pending))
+			{
+				take(message, pending);
+				wakeProducers();
+				return true;
+			}
+			if (closed_)
+				return false;
+			if (i >= kSpinCount)
+				std::this_thread::yield();
+		}
+
+		std::unique_lock<std::mutex> lk(mtx_);
+		while (true)
+		{
+			sleeping_.store(true, std::memory_order_seq_cst);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (tryPop(message, pending))
+			{
+				sleeping_.store(false, std::memory_order_relaxed);
+				lk.unlock();
+				take(message, pending);
+				wakeProducers();
+				return true;
+			}
+			if (closed_)
+			{
+				sleeping_.store(false, std::memory_order_relaxed);
+				return false;
+			}
+			cond_consumer_.wait(lk);
+		}
+	}
+
+	bool NotificationQueue::poll(json& message)
+	{
+		std::shared_ptr<pending_t> pending;
+		if (!tryPop(message, pending))
+			return false;
+
+		take(message, pending);
+		wakeProducers();
+		return true;
+	}
+
+	void NotificationQueue::close()
+	{
+		closed_ = true;
+		std::lock_guard<std::mutex> lk(mtx_);
+		cond_consumer_.notify_all();
+		cond_producer_.notify_all();
+	}
+
+	size_t NotificationQueue::size() const
+	{
+		size_t enqueue = enqueue_pos_.load(std::memory_order_relaxed);
+		size_t dequeue = dequeue_pos_.load(std::memory_order_relaxed);
+		return (enqueue > dequeue ? enqueue - dequeue : 0) + spilled_.load(std::memory_order_relaxed);
+	}
+
+	notification_stats NotificationQueue::stats() const
+	{
+		return {
+			queued_.load(std::memory_order_relaxed),
+			dropped_.load(std::memory_order_relaxed),
+			coalesced_.load(std::memory_order_relaxed),
+			high_water_.load(std::memory_order_relaxed)
+		};
+	}
+
+	bool NotificationQueue::tryPush(json& message, std::shared_ptr<pending_t>& pending)
+	{
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		while (true)
+		{
+			cell_t& cell = cells_[pos & mask_];
+			size_t seq = cell.sequence.load(std::memory_order_acquire);
+			intptr_t diff = intptr_t(seq) - intptr_t(pos);
+			if (diff == 0)
+			{
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					cell.data = std::move(message);
+					cell.pending = std::move(pending);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool NotificationQueue::tryPop(json& message, std::shared_ptr<pending_t>& pending)
+	{
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		while (true)
+		{
+			cell_t& cell = cells_[pos & mask_];
+			size_t seq = cell.sequence.load(std::memory_order_acquire);
+			intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+			if (diff == 0)
+			{
+				if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					message = std::move(cell.data);
+					pending = std::move(cell.pending);
+					cell.data = nullptr;
+					cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				break;
+			}
+			else
+			{
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+
+		// the ring is empty, so the spill list holds the oldest messages
+		if (!spilled_.load(std::memory_order_acquire))
+			return false;
+		std::lock_guard<std::mutex> lk(mtx_spill_);
+		if (spill_.empty())
+			return false;
+		message = std::move(spill_.front().first);
+		pending = std::move(spill_.front().second);
+		spill_.pop_front();
+		spilled_.fetch_sub(1, std::memory_order_release);
+		return true;
+	}
+
+	void NotificationQueue::spill(json& message, std::shared_ptr<pending_t>& pending)
+	{
+		std::lock_guard<std::mutex> lk(mtx_spill_);
+		// the consumer may have emptied the list meanwhile; the ring is then
+		// the place that keeps the order
+		if (spill_.empty() && tryPush(message, pending))
+			return;
+		spill_.emplace_back(std::move(message), std::move(pending));
+		spilled_.fetch_add(1, std::memory_order_release);
+	}
+
+	bool NotificationQueue::enqueue(json& message, std::shared_ptr<pending_t>& pending)
+	{
+		switch (policy_)
+		{
+		case OverflowPolicy::grow:
+			if (spilled_.load(std::memory_order_acquire) || !tryPush(message, pending))
+				spill(message, pending);
+			return true;
+		case OverflowPolicy::block:
+			while (!tryPush(message, pending))
+			{
+				if (closed_)
+					return false;
+
+				if (full_handler_)
+				{
+					full_handler_();
+					if (tryPush(message, pending))
+						break;
+				}
+
+				std::unique_lock<std::mutex> lk(mtx_);
+				producers_waiting_.fetch_add(1, std::memory_order_seq_cst);
+				if (tryPush(message, pending))
+				{
+					producers_waiting_.fetch_sub(1, std::memory_order_relaxed);
+					break;
+				}
+				cond_producer_.wait_for(lk, std::chrono::milliseconds(1));
+				producers_waiting_.fetch_sub(1, std::memory_order_relaxed);
+			}
+			return true;
+		case OverflowPolicy::drop_oldest:
+			while (!tryPush(message, pending))
+			{
+				json oldest;
+				std::shared_ptr<pending_t> dropped;
+				if (tryPop(oldest, dropped))
+				{
+					take(oldest, dropped);
+					dropped_.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			return true;
+		case OverflowPolicy::drop_newest:
+			if (tryPush(message, pending))
+				return true;
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		case OverflowPolicy::coalesce_by_key:
+			return enqueueCoalesced(message, pending);
+		}
+		return false;
+	}
+
+	bool NotificationQueue::enqueueCoalesced(json& message, std::shared_ptr<pending_t>& pending)
+	{
+		std::string key = key_ && !pending ? key_(message) : std::string();
+		if (key.empty())
+		{
+			if (tryPush(message, pending))
+				return true;
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		// the ring cell only carries the pending entry, so a later message with
+		// the same method and key can replace it until the consumer takes it
+		pending = std::make_shared<pending_t>();
+		pending->key = methodOf(message) + '\n' + key;
+		pending->message = std::move(message);
+
+		std::lock_guard<std::mutex> lk(mtx_pending_);
+		auto queued = pending;
+		if (tryPush(message, queued))
+		{
+			pending_[pending->key] = pending;
+			return true;
+		}
+
+		auto it = pending_.find(pending->key);
+		if (it != pending_.end())
+		{
+			it->second->message = std::move(pending->message);
+			coalesced_.fetch_add(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+		}
+		return false;
+	}
+
+	std::string NotificationQueue::coalesceKey(const json& message) const
+	{
+		if (coalesce_.empty())
+			return std::string();
+
+		const std::string& method = methodOf(message);
+		if (method.empty())
+			return std::string();
+
+		auto it = coalesce_.find(method);
+		if (it == coalesce_.end())
+			return std::string();
+
+		return method + '\n' + (it->second ? it->second(message) : std::string());
+	}
+
+	void NotificationQueue::forget(const std::shared_ptr<pending_t>& pending)
+	{
+		std::lock_guard<std::mutex> lk(mtx_pending_);
+		auto it = pending_.find(pending->key);
+		if (it != pending_.end() && it->second == pending)
+			pending_.erase(it);
+	}
+
+	void NotificationQueue::take(json& message, std::shared_ptr<pending_t>& pending)
+	{
+		if (!pending)
+			return;
+
+		std::lock_guard<std::mutex> lk(mtx_pending_);
+		message = std::move(pending->message);
+		auto it = pending_.find(pending->key);
+		if (it != pending_.end() && it->second == pending)
+			pending_.erase(it);
+		pending.reset();
+	}
+
+	void NotificationQueue::onQueued()
+	{
+		queued_.fetch_add(1, std::memory_order_relaxed);
+		size_t size = this->size();
+		size_t high = high_water_.load(std::memory_order_relaxed);
+		while (size > high && !high_water_.compare_exchange_weak(high, size, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	void NotificationQueue::wakeConsumer()
+	{
+		// pairs with the seq_cst store of sleeping_ in pop()
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!sleeping_.load(std::memory_order_relaxed))
+			return;
+
+		std::lock_guard<std::mutex> lk(mtx_);
+		sleeping_.store(false, std::memory_order_relaxed);
+		cond_consumer_.notify_one();
+	}
+
+	void NotificationQueue::wakeProducers()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (producers_waiting_.load(std::memory_order_relaxed) == 0)
+			return;
+
+		std::lock_guard<std::mutex> lk(mtx_);
+		cond_producer_.notify_all();
+	}
+}
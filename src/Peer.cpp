@@ -1,13 +1,136 @@
 #include "Peer.h"
+#include "Thread.h"
 #include <chrono>
+#include <deque>
+#include <boost/asio/post.hpp>
 
 namespace protoo
 {
 	using nlohmann::json;
 
+	Responder::Responder(Message&& request, std::shared_ptr<link_t> link)
+		: state_(std::make_shared<state_t>())
+	{
+		state_->id = request.id();
+		state_->message = std::move(request);
+		state_->link = std::move(link);
+		state_->done = false;
+	}
+
+	const json& Responder::request() const
+	{
+		auto state = state_.get();
+		std::call_once(state->parsed, [state]() { state->request = state->message.release(); });
+		return state->request;
+	}
+
+	const json& Responder::data() const
+	{
+		static const json none;
+		const json& message = request();
+		auto it = message.find("data");
+		return it == message.end() ? none : *it;
+	}
+
+	void Responder::accept(const json& data) const
+	{
+		json response =
+		{
+			{"response", true},
+			{"id", state_->id},
+			{"ok", true},
+			{"data", data}
+		};
+		respond(std::move(response));
+	}
+
+	void Responder::reject(int errorCode, const std::string& errorReason) const
+	{
+		json response =
+		{
+			{"response", true},
+			{"id", state_->id},
+			{"ok", false},
+			{"errorCode", errorCode},
+			{"errorReason", errorReason}
+		};
+		respond(std::move(response));
+	}
+
+	void Responder::respond(json&& response) const
+	{
+		if (state_->done.exchange(true))
+			return;
+
+		auto finished = std::move(state_->finished);
+		state_->finished = nullptr;
+		if (finished) finished();
+
+		std::lock_guard<std::mutex> lk(state_->link->mtx);
+		if (!state_->link->transport)
+			return;
+		try
+		{
+			state_->link->transport->send(response, SendLane::priority);
+		}
+		catch (const std::exception& e)
+		{
+			// the connection went away; the request dies with it
+			PROTOO_LOG_WARN(logger) << "dropping response [error:" << e.what() << "]";
+		}
+	}
+
 	Peer::Peer(std::unique_ptr<WebSocketTransport> transport)
+		: Peer(std::move(transport), PeerThreading::threaded)
+	{
+	}
+
+	Peer::Peer(std::unique_ptr<WebSocketTransport> transport, PeerThreading threading)
 		: transport_(std::move(transport))
+		, link_(std::make_shared<Responder::link_t>())
+		, single_threaded_(threading == PeerThreading::single_threaded)
+		, request_metrics_(std::make_shared<request_metrics_t>())
 	{
+		if (single_threaded_)
+		{
+			ioc_ = &transport_->get_io_context();
+			timer_ = std::make_shared<TimerWheel>(*ioc_);
+		}
+		else
+		{
+			timer_ = std::make_shared<TimerWheel>();
+		}
+		init();
+	}
+
+	Peer::Peer(std::unique_ptr<WebSocketTransport> transport, boost::asio::io_context& ioc)
+		: Peer(std::move(transport), ioc, std::make_shared<TimerWheel>(ioc))
+	{
+	}
+
+	Peer::Peer(std::unique_ptr<WebSocketTransport> transport, boost::asio::io_context& ioc,
+		std::shared_ptr<TimerWheel> timer, executor notificationExecutor)
+		: transport_(std::move(transport))
+		, link_(std::make_shared<Responder::link_t>())
+		, ioc_(&ioc)
+		, timer_(std::move(timer))
+		, notification_executor_(std::move(notificationExecutor))
+		, request_metrics_(std::make_shared<request_metrics_t>())
+	{
+		if (!notification_executor_)
+		{
+			boost::asio::io_context* context = ioc_;
+			notification_executor_ = [context](std::function<void(void)> task) { boost::asio::post(*context, std::move(task)); };
+		}
+		init();
+	}
+
+	void Peer::init()
+	{
+		for (auto& latency : executor_latency_)
+			latency = std::make_shared<Histogram>();
+
+		link_->transport = transport_.get();
 		if (transport_->closed_)
 		{
 			closed_ = true;
@@ -22,54 +145,344 @@ namespace protoo
 		transport_->close_handler_ = std::bind(&Peer::onClose, this);
 		transport_->failed_handler_ = std::bind(&Peer::onFailed, this, _1);
 		transport_->message_handler_ = std::bind(&Peer::onMessage, this, _1);
+		// handlers set on the transport itself run first
+		auto highWater = std::move(transport_->high_water_handler_);
+		auto lowWater = std::move(transport_->low_water_handler_);
+		transport_->high_water_handler_ = [this, highWater]()
+		{
+			if (highWater) highWater();
+			onHighWater();
+		};
+		transport_->low_water_handler_ = [this, lowWater]()
+		{
+			if (lowWater) lowWater();
+			onLowWater();
+		};
+		transport_->start();
 	}
 
 	Peer::~Peer()
 	{
 		close();
+		// the io thread may still be calling in, e.g. onLowWater from a write
+		transport_->detach();
+
+		std::lock_guard<std::mutex> lk(link_->mtx);
+		link_->transport = nullptr;
 	}
 
 	json Peer::request(const std::string& method, const json& data)
 	{
-		std::uniform_int_distribution<uint16_t> u;
-		int id = u(random_);
-		json request =
+		if (ioc_ && ioc_->get_executor().running_in_this_thread())
+			throw std::runtime_error("blocking request on the io thread");
+		return requestAsync(method, data).get();
+	}
+
+	std::future<json> Peer::requestAsync(const std::string& method, const json& data)
+	{
+		auto promise = std::make_shared<std::promise<json>>();
+		auto future = promise->get_future();
+		requestAsync(method, data, fulfil(promise));
+		return future;
+	}
+
+	void Peer::requestAsync(const std::string& method, const json& data, executor ex, response_handler h)
+	{
+		if (!ex)
 		{
-			{"request", true},
-			{"id", id},
-			{"method", method},
-			{"data", data}
-		};
+			requestAsync(method, data, std::move(h));
+			return;
+		}
 
-		transport_->send(request);
+		requestAsync(method, data, [ex, h](const json& response, std::exception_ptr error)
+			{
+				ex([h, response, error]() { h(response, error); });
+			});
+	}
 
-		mtx_sents_.lock();
-		auto& sent = sents_[id];
-		int size = sents_.size();
-		sent.clock = std::chrono::steady_clock::now() + std::chrono::milliseconds(1500 * (15 + int(0.1 * size)));
-		auto future = sent.promise.get_future();
-		mtx_sents_.unlock();
+	void Peer::requestAsync(const std::string& method, const json& data, response_handler h)
+	{
+		int id = track(h);
+		if (!id)
+			return;
 
 		try
 		{
-			const json& response = future.get();
-			return response;
+			transport_->send(makeRequest(id, method, data), SendLane::priority);
 		}
-		catch (const std::exception& e)
+		catch (const std::exception&)
+		{
+			fail(id, std::current_exception());
+		}
+	}
+
+	std::vector<std::future<json>> Peer::requestBatch(const std::vector<std::pair<std::string, json>>& requests)
+	{
+		std::vector<std::future<json>> futures;
+		if (!transport_->batching() || requests.size() < 2)
+		{
+			for (auto& request : requests)
+				futures.push_back(requestAsync(request.first, request.second));
+			return futures;
+		}
+
+		json batch = json::array();
+		std::vector<int> ids;
+		for (auto& request : requests)
+		{
+			auto promise = std::make_shared<std::promise<json>>();
+			futures.push_back(promise->get_future());
+			response_handler h = fulfil(promise);
+			int id = track(h);
+			if (!id)
+				continue;
+			ids.push_back(id);
+			batch.push_back(makeRequest(id, request.first, request.second));
+		}
+		if (batch.empty())
+			return futures;
+
+		try
+		{
+			transport_->send(batch, SendLane::priority);
+		}
+		catch (const std::exception&)
+		{
+			for (int id : ids)
+				fail(id, std::current_exception());
+		}
+		return futures;
+	}
+
+	struct Peer::pipeline_t
+	{
+		typedef struct
+		{
+			bool ready;
+			json data;
+			std::exception_ptr error;
+		}result_t;
+
+		std::vector<std::pair<std::string, json>> requests;
+		size_t window;
+		bool ordered;
+		pipeline_handler handler;
+		std::promise<void> finished;
+
+		std::mutex mtx;
+		size_t next{ 0 };
+		size_t in_flight{ 0 };
+		size_t delivered{ 0 };
+		bool issuing{ false };
+		// ordered only: results waiting for an earlier one
+		std::vector<result_t> results;
+		// collected for handler, which only the one delivering thread calls,
+		// with mtx released, so that a handler may complete more requests
+		// (for example by closing the peer) without deadlocking
+		std::deque<std::pair<size_t, result_t>> pending;
+		bool delivering{ false };
+	};
+
+	std::future<void> Peer::requestPipeline(std::vector<std::pair<std::string, json>> requests, size_t window, bool ordered,
+		pipeline_handler h)
+	{
+		auto pipeline = std::make_shared<pipeline_t>();
+		pipeline->requests = std::move(requests);
+		pipeline->window = window ? window : 1;
+		pipeline->ordered = ordered;
+		pipeline->handler = std::move(h);
+		if (ordered)
+			pipeline->results.resize(pipeline->requests.size());
+
+		auto future = pipeline->finished.get_future();
+		if (pipeline->requests.empty())
+			pipeline->finished.set_value();
+		else
+			issue(this, pipeline);
+		return future;
+	}
+
+	void Peer::issue(Peer* peer, const std::shared_ptr<pipeline_t>& pipeline)
+	{
+		{
+			// completions during the loop below only free window slots, which
+			// the loop picks up itself instead of recursing
+			std::lock_guard<std::mutex> lk(pipeline->mtx);
+			if (pipeline->issuing)
+				return;
+			pipeline->issuing = true;
+		}
+
+		while (true)
+		{
+			size_t index;
+			{
+				std::lock_guard<std::mutex> lk(pipeline->mtx);
+				if (pipeline->in_flight >= pipeline->window || pipeline->next == pipeline->requests.size())
+				{
+					pipeline->issuing = false;
+					return;
+				}
+				index = pipeline->next++;
+				pipeline->in_flight++;
+			}
+
+			// unlocked: a failed send completes the request right here
+			auto& request = pipeline->requests[index];
+			std::shared_ptr<pipeline_t> owner = pipeline;
+			peer->requestAsync(request.first, request.second, [peer, owner, index](const json& data, std::exception_ptr error)
+				{
+					complete(peer, owner, index, data, error);
+				});
+		}
+	}
+
+	void Peer::complete(Peer* peer, const std::shared_ptr<pipeline_t>& pipeline, size_t index, const json& data, std::exception_ptr error)
+	{
+		std::unique_lock<std::mutex> lk(pipeline->mtx);
+		pipeline->in_flight--;
+		if (!pipeline->ordered)
+		{
+			pipeline->pending.push_back({ index, { true, data, error } });
+			pipeline->delivered++;
+		}
+		else
+		{
+			pipeline->results[index] = { true, data, error };
+			while (pipeline->delivered < pipeline->results.size())
+			{
+				auto& result = pipeline->results[pipeline->delivered];
+				if (!result.ready)
+					break;
+				pipeline->pending.push_back({ pipeline->delivered++, std::move(result) });
+				result.data = nullptr;
+			}
+		}
+
+		// the thread already delivering, maybe further up this stack, picks
+		// the results up and issues the freed window slots when it is done
+		if (pipeline->delivering)
+			return;
+		pipeline->delivering = true;
+		while (!pipeline->pending.empty())
 		{
-			throw e;
+			auto result = std::move(pipeline->pending.front());
+			pipeline->pending.pop_front();
+			lk.unlock();
+			if (pipeline->handler)
+				pipeline->handler(result.first, result.second.data, result.second.error);
+			lk.lock();
 		}
+		pipeline->delivering = false;
+		bool last = pipeline->delivered == pipeline->requests.size();
+		lk.unlock();
+
+		if (last)
+			pipeline->finished.set_value();
+		else
+			issue(peer, pipeline);
 	}
 
 	void Peer::notify(const std::string& method, const json& data)
 	{
+		if (!transport_->admit(notify_backpressure_))
+			throw std::runtime_error("send buffer full");
+		transport_->send(makeNotification(method, data));
+	}
+
+	void Peer::notifyRaw(const std::string& method, boost::string_view data)
+	{
+		if (!transport_->admit(notify_backpressure_))
+			throw std::runtime_error("send buffer full");
 		json notification =
+		{
+			{"notification", true},
+			{"method", method}
+		};
+		transport_->send(notification, data);
+	}
+
+	void Peer::notifyMany(const std::vector<std::pair<std::string, json>>& notifications)
+	{
+		if (!transport_->batching() || notifications.size() < 2)
+		{
+			for (auto& notification : notifications)
+				notify(notification.first, notification.second);
+			return;
+		}
+
+		if (!transport_->admit(notify_backpressure_))
+			throw std::runtime_error("send buffer full");
+		json batch = json::array();
+		for (auto& notification : notifications)
+			batch.push_back(makeNotification(notification.first, notification.second));
+		if (!batch.empty())
+			transport_->send(batch);
+	}
+
+	int Peer::track(response_handler& h)
+	{
+		int size = sents_.size();
+		int id = sents_.emplace([&](int id, sent_t& sent)
+			{
+				sent.handler = std::move(h);
+				sent.sent = std::chrono::steady_clock::now();
+				sent.timer = timer_->schedule(std::chrono::milliseconds(1500 * (15 + int(0.1 * size))),
+					std::bind(&Peer::onRequestTimeout, this, link_, id));
+			});
+		if (!id)
+			h(nullptr, std::make_exception_ptr(std::runtime_error("too many pending requests")));
+		return id;
+	}
+
+	void Peer::fail(int id, std::exception_ptr error)
+	{
+		sent_t sent;
+		if (sents_.take(id, sent))
+		{
+			timer_->cancel(sent.timer);
+			sent.handler(nullptr, error);
+		}
+	}
+
+	response_handler Peer::fulfil(std::shared_ptr<std::promise<json>> promise)
+	{
+		return [promise](const json& response, std::exception_ptr error)
+		{
+			if (error)
+				promise->set_exception(error);
+			else
+				promise->set_value(response);
+		};
+	}
+
+	json Peer::makeRequest(int id, const std::string& method, const json& data)
+	{
+		return
+		{
+			{"request", true},
+			{"id", id},
+			{"method", method},
+			{"data", data}
+		};
+	}
+
+	json Peer::makeNotification(const std::string& method, const json& data)
+	{
+		return
 		{
 			{"notification", true},
 			{"method", method},
 			{"data", data}
 		};
-		transport_->send(notification);
+	}
+
+	notification_stats Peer::get_notification_stats()
+	{
+		std::lock_guard<std::mutex> lk(notifications_mtx_);
+		if (!notifications_)
+			return { 0, 0, 0, 0 };
+		return notifications_->stats();
 	}
 
 	void Peer::close()
@@ -78,8 +491,17 @@ namespace protoo
 		connected_ = false;
 
 		transport_->close();
-		sents_.clear();
-		if (close_handler_) close_handler_();
+		failSents("peer closed");
+		NotificationDispatcher* notifications;
+		{
+			// not held while closing, which may wait for handlers
+			std::lock_guard<std::mutex> lk(notifications_mtx_);
+			notifications = notifications_.get();
+		}
+		if (notifications) notifications->close();
+		if (request_pool_) request_pool_->stop();
+		if (open_thread_) joinThread(*open_thread_);
+		if (close_handler_ && !dispatch(HandlerCategory::close, close_handler_)) close_handler_();
 	}
 
 	void Peer::onOpen()
@@ -88,12 +510,42 @@ namespace protoo
 			return;
 
 		connected_ = true;
-		if (open_handler_)
+		if (open_handler_ && !dispatch(HandlerCategory::open, open_handler_))
 		{
-			open_thread_ = std::make_unique<std::thread>(open_handler_);
+			if (single_threaded_)
+			{
+				open_handler_();
+			}
+			else if (ioc_)
+			{
+				boost::asio::post(*ioc_, guarded([this]()
+					{
+						if (!closed_ && open_handler_) open_handler_();
+					}));
+			}
+			else
+			{
+				// the previous open handler may still be issuing requests that need
+				// this thread to receive their responses, so it cannot be joined here
+				if (open_thread_ && open_thread_->joinable())
+					open_thread_->detach();
+				open_thread_ = std::make_unique<std::thread>(open_handler_);
+			}
+		}
+		if (!notifications_ && (!single_threaded_ || notification_executor_))
+		{
+			using websocketpp::lib::placeholders::_1;
+			auto deliver = std::bind(&Peer::handleNotification, this, _1);
+			std::lock_guard<std::mutex> lk(notifications_mtx_);
+			if (notification_executor_)
+			{
+				notifications_ = std::make_unique<NotificationDispatcher>(deliver, notification_options_, notification_executor_);
+			}
+			else
+			{
+				notifications_ = std::make_unique<NotificationDispatcher>(deliver, notification_options_);
+			}
 		}
-		timer_thread_ = std::make_unique<std::thread>(&Peer::onTimer ,this);
-		notification_thread_ = std::make_unique<std::thread>(&Peer::handleNotification, this);
 	}
 
 	void Peer::onDisconnected()
@@ -102,7 +554,7 @@ namespace protoo
 			return;
 
 		connected_ = false;
-		if(disconnected_handler_) disconnected_handler_();
+		if (disconnected_handler_ && !dispatch(HandlerCategory::disconnected, disconnected_handler_)) disconnected_handler_();
 	}
 
 	void Peer::onFailed(int currentAttempt)
@@ -111,7 +563,12 @@ namespace protoo
 			return;
 
 		connected_ = false;
-		if(failed_handler_) failed_handler_(currentAttempt);
+		if (!failed_handler_)
+			return;
+
+		failed_handler h = failed_handler_;
+		if (!dispatch(HandlerCategory::failed, [h, currentAttempt]() { h(currentAttempt); }))
+			h(currentAttempt);
 	}
 
 	void Peer::onClose()
@@ -121,140 +578,262 @@ namespace protoo
 
 		closed_ = true;
 		connected_ = false;
-		if(close_handler_) close_handler_();
+		if (notifications_) notifications_->close();
+		if (close_handler_ && !dispatch(HandlerCategory::close, close_handler_)) close_handler_();
+	}
+
+	void Peer::onHighWater()
+	{
+		if (high_water_handler_) high_water_handler_();
 	}
 
-	void Peer::onMessage(const json& message)
+	void Peer::onLowWater()
 	{
-		if (message.find("request") != message.end())
-			handleRequest(message);
-		else if (message.find("response") != message.end())
+		if (low_water_handler_) low_water_handler_();
+	}
+
+	void Peer::onMessage(Message&& message)
+	{
+		if (message.is_batch())
+		{
+			// a batch, see BatchMode
+			json batch = message.release();
+			for (auto& element : batch)
+				onMessage(Message(std::move(element)));
+			return;
+		}
+
+		if (message.is_request())
+			handleRequest(std::move(message));
+		else if (message.is_response())
 			handleResponse(message);
-		else if (message.find("notification") != message.end())
+		else if (message.is_notification())
 		{
-			mtx_notification_.lock();
-			notification_message_.push_back(message);
-			mtx_notification_.unlock();
-			cond_notification_.notify_one();
+			const std::string& method = message.method();
+			const notification_handler* handler = notification_handlers_.find(method);
+			const raw_notification_handler* raw = raw_notification_handlers_.find(method);
+			if (!raw && !handler && !notification_handler_ && raw_notification_handler_)
+				raw = &raw_notification_handler_;
+			if (raw)
+			{
+				handleRawNotification(*raw, message);
+				return;
+			}
+			// nobody listening: data is never parsed
+			if (!handler && !notification_handler_)
+				return;
+
+			json notification = message.release();
+			if (single_threaded_ && !notification_executor_)
+				handleNotification(notification);
+			else if (notifications_)
+				notifications_->push(std::move(notification));
 		}
 	}
 
-	void Peer::handleRequest(const json& request)
+	void Peer::handleRequest(Message&& request)
 	{
-		try
+		const async_request_handler* handler = request_handlers_.find(request.method());
+		if (!handler)
+			handler = &request_handler_;
+		if (!*handler)
+			return;
+
+		auto received = std::chrono::steady_clock::now();
+		auto metrics = request_metrics_;
+		Responder responder(std::move(request), link_);
+		if (max_requests_ && metrics->in_flight >= max_requests_)
 		{
-			if(request_handler_) request_handler_(request,
-				[this, &request](const json& data)
-				{
-					json response =
-					{
-						{"response", true},
-						{"id", request["id"]},
-						{"ok", true},
-						{"data", data}
-					};
-					transport_->send(response);
-				},
-				[this, &request](int errorCode, const std::string& errorReason)
-				{
-					json response =
-					{
-						{"response", true},
-						{"id", request["id"]},
-						{"ok", false},
-						{"errorCode", errorCode},
-						{"errorReason", errorReason}
-					};
-					transport_->send(response);
-				});
+			metrics->rejected++;
+			responder.reject(busy_code_, "busy");
+			return;
 		}
-		catch (const std::exception& e)
+
+		metrics->in_flight++;
+		responder.state_->finished = [metrics]() { metrics->in_flight--; };
+
+		if (!executors_[size_t(HandlerCategory::request)] && !request_pool_)
 		{
-			json response =
-			{
-				{"response", true},
-				{"id", request["id"]},
-				{"ok", false},
-				{"errorCode", 500},
-				{"errorReason", e.what()}
-			};
-			transport_->send(response);
+			runRequest(*handler, responder, received);
+			return;
 		}
+
+		async_request_handler h = *handler;
+		auto task = [this, h, responder, received]()
+		{
+			runRequest(h, responder, received);
+		};
+		if (!dispatch(HandlerCategory::request, task))
+			request_pool_->post(task);
 	}
 
-	void Peer::handleResponse(const json& response)
+	void Peer::runRequest(const async_request_handler& handler, Responder responder, std::chrono::steady_clock::time_point received)
 	{
-		int id = response["id"];
-		std::unique_lock<std::mutex> lk(mtx_sents_);
-		auto it = sents_.find(id);
-		if (it == sents_.end())
+		auto metrics = request_metrics_;
+		auto started = std::chrono::steady_clock::now();
+		metrics->queue_wait.record(started - received);
+		responder.state_->finished = [metrics, started]()
 		{
-			PROTOO_LOG_ERROR(logger) << "received response does not match any sent request [id:" << id << "]";
-			return;
+			metrics->duration.record(std::chrono::steady_clock::now() - started);
+			metrics->in_flight--;
+		};
+
+		try
+		{
+			handler(responder);
+		}
+		catch (const std::exception& e)
+		{
+			responder.reject(500, e.what());
 		}
+	}
 
-		auto okIt = response.find("ok");
-		if (okIt != response.end()
-			&& okIt->is_boolean()
-			&& okIt->get<bool>())
+	void Peer::set_executor(HandlerCategory category, executor ex)
+	{
+		size_t index = size_t(category);
+		if (ex)
 		{
-			it->second.promise.set_value(response["data"]);
-			sents_.erase(it);
+			std::shared_ptr<Histogram> latency = executor_latency_[index];
+			executors_[index] = [ex, latency](std::function<void(void)> task)
+			{
+				auto posted = std::chrono::steady_clock::now();
+				ex([latency, posted, task]()
+					{
+						latency->record(std::chrono::steady_clock::now() - posted);
+						task();
+					});
+			};
 		}
 		else
 		{
-			std::string reason = response["errorReason"];
-			it->second.promise.set_exception(std::make_exception_ptr(std::exception(reason.c_str())));
-			sents_.erase(it);
+			executors_[index] = nullptr;
 		}
+
+		if (category == HandlerCategory::notification)
+			notification_executor_ = executors_[index];
+	}
+
+	bool Peer::dispatch(HandlerCategory category, std::function<void(void)> task)
+	{
+		const executor& ex = executors_[size_t(category)];
+		if (!ex)
+			return false;
+
+		ex(guarded(std::move(task)));
+		return true;
 	}
 
-	void Peer::handleNotification()
+	std::function<void(void)> Peer::guarded(std::function<void(void)> task) const
 	{
-		while (!closed_)
+		std::shared_ptr<Responder::link_t> link = link_;
+		return [link, task]()
 		{
-			std::unique_lock<std::mutex> lk(mtx_notification_);
-			if (notification_message_.empty())
 			{
-				cond_notification_.wait(lk);
-				if (closed_)
-				{
+				std::lock_guard<std::mutex> lk(link->mtx);
+				if (!link->transport)
 					return;
-				}
 			}
-			auto message = *notification_message_.begin();
-			notification_message_.pop_front();
-			lk.unlock();
-			if(notification_handler_)
-				notification_handler_(message);
-		}
+			task();
+		};
+	}
+
+	void Peer::set_request_workers(size_t threads, size_t maxConcurrency, int busyCode)
+	{
+		request_pool_ = threads ? std::make_unique<ThreadPool>(threads) : nullptr;
+		max_requests_ = maxConcurrency;
+		busy_code_ = busyCode;
 	}
 
-	void Peer::onTimer()
+	async_request_handler Peer::wrap(request_handler h)
 	{
-		bool empty{ true };
-		while (!closed_)
+		if (!h)
+			return nullptr;
+
+		return [h](Responder responder)
+		{
+			h(responder.request(),
+				[responder](const json& data) { responder.accept(data); },
+				[responder](int errorCode, const char* errorReason) { responder.reject(errorCode, errorReason); });
+		};
+	}
+
+	void Peer::handleResponse(Message& response)
+	{
+		int id = response.id();
+		sent_t sent;
+		if (!sents_.take(id, sent))
+		{
+			PROTOO_LOG_ERROR(logger) << "received response does not match any sent request [id:" << id << "]";
+			return;
+		}
+		timer_->cancel(sent.timer);
+		transport_->observeRtt(std::chrono::steady_clock::now() - sent.sent);
+		auto& handler = sent.handler;
+
+		if (response.ok())
 		{
-			empty = true;
-			std::chrono::steady_clock::time_point clock = std::chrono::steady_clock::now();
-			std::unique_lock<std::mutex> lk(mtx_sents_);
-			for (auto it = sents_.begin(); it != sents_.end(); ++it)
+			static const json empty = json::object();
+			const json* data = &empty;
+			try
 			{
-				if (it->second.clock <= clock)
-				{
-					it->second.promise.set_exception(std::make_exception_ptr(std::exception("request timeout")));
-					sents_.erase(it);
-					empty = false;
-					break;
-				}
+				if (response.has_data())
+					data = &response.data();
 			}
-			if (empty)
+			catch (const std::exception&)
 			{
-				lk.unlock();
-				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				handler(nullptr, std::current_exception());
+				return;
 			}
+			handler(*data, nullptr);
+		}
+		else
+		{
+			std::string reason = response.envelope().value("errorReason", "");
+			handler(nullptr, std::make_exception_ptr(std::runtime_error(reason)));
 		}
 	}
 
-}
+	void Peer::handleNotification(const json& notification)
+	{
+		const notification_handler* handler = notification_handlers_.find(methodOf(notification));
+		if (handler)
+			(*handler)(notification);
+		else if(notification_handler_)
+			notification_handler_(notification);
+	}
+
+	void Peer::handleRawNotification(const raw_notification_handler& handler, Message& notification)
+	{
+		boost::string_view data = notification.raw_data();
+		// data of a batch element arrives parsed
+		std::string dumped;
+		if (data.empty() && notification.has_data())
+		{
+			dumped = notification.data().dump();
+			data = dumped;
+		}
+		handler(notification.envelope(), data);
+	}
+
+	void Peer::onRequestTimeout(Peer* peer, std::shared_ptr<Responder::link_t> link, int id)
+	{
+		sent_t sent;
+		{
+			// ~Peer clears the transport under this lock before peer goes away
+			std::lock_guard<std::mutex> lk(link->mtx);
+			if (!link->transport || !peer->sents_.take(id, sent))
+				return;
+		}
+		sent.handler(nullptr, std::make_exception_ptr(std::runtime_error("request timeout")));
+	}
 
+	void Peer::failSents(const char* reason)
+	{
+		sents_.drain([this, reason](int, sent_t& sent)
+			{
+				timer_->cancel(sent.timer);
+				sent.handler(nullptr, std::make_exception_ptr(std::runtime_error(reason)));
+			});
+	}
+
+}
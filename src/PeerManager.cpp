@@ -0,0 +1,120 @@
+#include "PeerManager.h"
+#include "Thread.h"
+#include <future>
+#include <boost/asio/post.hpp>
+
+namespace protoo
+{
+	PeerManager::PeerManager(const peer_manager_options& options)
+		: assignment_(options.assignment)
+	{
+		if (options.notification_threads)
+			notification_pool_ = std::make_shared<ThreadPool>(options.notification_threads);
+
+		size_t threads = options.threads ? options.threads : 1;
+		for (size_t i = 0; i < threads; ++i)
+			reactors_.push_back(std::make_shared<reactor_t>());
+		for (auto& reactor : reactors_)
+		{
+			reactor_t* raw = reactor.get();
+			reactor->thread = std::thread([raw]() { raw->ioc.run(); });
+		}
+	}
+
+	PeerManager::~PeerManager()
+	{
+		stop();
+	}
+
+	std::shared_ptr<Peer> PeerManager::create(const std::string& url, setup_handler setup, void* options)
+	{
+		for (auto& reactor : reactors_)
+		{
+			if (reactor->thread.get_id() == std::this_thread::get_id())
+				return createOn(reactor, url, setup, options);
+		}
+
+		auto reactor = pick();
+		if (reactor->ioc.stopped())
+			throw std::runtime_error("peer manager stopped");
+
+		// built on the io thread so that connecting, which the transport posts
+		// there, cannot start before setup has run
+		std::promise<std::shared_ptr<Peer>> promise;
+		boost::asio::post(reactor->ioc, [&]()
+			{
+				try
+				{
+					promise.set_value(createOn(reactor, url, setup, options));
+				}
+				catch (...)
+				{
+					promise.set_exception(std::current_exception());
+				}
+			});
+		return promise.get_future().get();
+	}
+
+	void PeerManager::stop()
+	{
+		for (auto& reactor : reactors_)
+		{
+			reactor->work.reset();
+			reactor->timer->stop();
+			reactor->ioc.stop();
+		}
+		for (auto& reactor : reactors_)
+			joinThread(reactor->thread);
+		if (notification_pool_)
+			notification_pool_->stop();
+	}
+
+	size_t PeerManager::peers() const
+	{
+		size_t total = 0;
+		for (auto& reactor : reactors_)
+			total += reactor->peers;
+		return total;
+	}
+
+	std::vector<size_t> PeerManager::load() const
+	{
+		std::vector<size_t> load;
+		for (auto& reactor : reactors_)
+			load.push_back(reactor->peers);
+		return load;
+	}
+
+	std::shared_ptr<PeerManager::reactor_t> PeerManager::pick()
+	{
+		if (assignment_ == PeerAssignment::round_robin)
+			return reactors_[next_++ % reactors_.size()];
+
+		auto best = reactors_[0];
+		for (auto& reactor : reactors_)
+		{
+			if (reactor->peers < best->peers)
+				best = reactor;
+		}
+		return best;
+	}
+
+	std::shared_ptr<Peer> PeerManager::createOn(const std::shared_ptr<reactor_t>& reactor, const std::string& url,
+		const setup_handler& setup, void* options)
+	{
+		executor ex = notification_pool_ ? poolExecutor(notification_pool_) : nullptr;
+		auto transport = std::make_unique<WebSocketTransport>(url, options, reactor->ioc);
+		std::shared_ptr<reactor_t> owner = reactor;
+		std::shared_ptr<Peer> peer(new Peer(std::move(transport), reactor->ioc, reactor->timer, ex), [owner](Peer* peer)
+			{
+				// the reactor, and so its io_context, outlives every peer on it
+				delete peer;
+				--owner->peers;
+			});
+		++reactor->peers;
+
+		if (setup)
+			setup(*peer);
+		return peer;
+	}
+}
@@ -0,0 +1,14 @@
+#include "Thread.h"
+
+namespace protoo
+{
+	void joinThread(std::thread& thread)
+	{
+		if (!thread.joinable())
+			return;
+		if (thread.get_id() == std::this_thread::get_id())
+			thread.detach();
+		else
+			thread.join();
+	}
+}
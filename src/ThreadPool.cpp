@@ -0,0 +1,63 @@
+#include "ThreadPool.h"
+#include "Thread.h"
+
+namespace protoo
+{
+	ThreadPool::ThreadPool(size_t threads)
+	{
+		if (threads == 0)
+			threads = 1;
+		for (size_t i = 0; i < threads; ++i)
+			threads_.emplace_back(&ThreadPool::run, this);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		stop();
+	}
+
+	void ThreadPool::post(task t)
+	{
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			if (stopped_)
+				return;
+			tasks_.push_back(std::move(t));
+		}
+		cond_.notify_one();
+	}
+
+	void ThreadPool::stop()
+	{
+		std::deque<task> tasks;
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			stopped_ = true;
+			std::swap(tasks, tasks_);
+		}
+		cond_.notify_all();
+		// destroyed outside the lock, tasks may own objects with side effects
+		tasks.clear();
+
+		for (auto& thread : threads_)
+			joinThread(thread);
+	}
+
+	void ThreadPool::run()
+	{
+		std::unique_lock<std::mutex> lk(mtx_);
+		while (true)
+		{
+			cond_.wait(lk, [this]() { return stopped_ || !tasks_.empty(); });
+			if (stopped_)
+				return;
+
+			task t = std::move(tasks_.front());
+			tasks_.pop_front();
+			lk.unlock();
+			t();
+			t = nullptr;
+			lk.lock();
+		}
+	}
+}
@@ -0,0 +1,215 @@
+#include "TimerWheel.h"
+#include "Thread.h"
+#include <algorithm>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/post.hpp>
+
+namespace protoo
+{
+	TimerWheel::TimerWheel(clock::duration tick, size_t slots)
+		: tick_(tick)
+		, start_(clock::now())
+		, slots_(slots)
+	{
+		thread_ = std::thread(&TimerWheel::run, this);
+	}
+
+	TimerWheel::TimerWheel(boost::asio::io_context& ioc, clock::duration tick, size_t slots)
+		: tick_(tick)
+		, start_(clock::now())
+		, slots_(slots)
+		, strand_(std::make_unique<boost::asio::io_context::strand>(ioc))
+		, timer_(std::make_unique<boost::asio::steady_timer>(ioc))
+	{
+	}
+
+	TimerWheel::~TimerWheel()
+	{
+		stop();
+	}
+
+	TimerWheel::timer_id TimerWheel::schedule(clock::duration timeout, timer_handler h)
+	{
+		std::unique_lock<std::mutex> lk(mtx_);
+		uint64_t tick = std::max(tickOf(clock::now() + timeout), current_ + 1);
+		auto& slot = slots_[tick % slots_.size()];
+		timer_id id = next_id_++;
+
+		slot.push_back({ id, tick, std::move(h) });
+		entries_[id] = std::prev(slot.end());
+
+		if (tick < wakeup_)
+		{
+			wakeup_ = tick;
+			lk.unlock();
+			wake();
+		}
+		return id;
+	}
+
+	bool TimerWheel::cancel(timer_id id)
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		auto it = entries_.find(id);
+		if (it == entries_.end())
+			return false;
+
+		slots_[it->second->tick % slots_.size()].erase(it->second);
+		entries_.erase(it);
+		return true;
+	}
+
+	void TimerWheel::stop()
+	{
+		mtx_.lock();
+		stopped_ = true;
+		mtx_.unlock();
+		cond_.notify_one();
+
+		// the pending steady_timer wait sees stopped_ and does nothing
+		if (strand_)
+			return;
+
+		joinThread(thread_);
+	}
+
+	size_t TimerWheel::size()
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		return entries_.size();
+	}
+
+	void TimerWheel::run()
+	{
+		std::vector<timer_handler> due;
+		std::unique_lock<std::mutex> lk(mtx_);
+		while (!stopped_)
+		{
+			uint64_t now = (clock::now() - start_) / tick_;
+			if (now > current_)
+				expire(now, due);
+
+			if (!due.empty())
+			{
+				// handlers run unlocked; schedule() need not wake us meanwhile
+				wakeup_ = 0;
+				lk.unlock();
+				for (auto& handler : due)
+					handler();
+				due.clear();
+				lk.lock();
+				continue;
+			}
+
+			wakeup_ = nextTick();
+			if (wakeup_ == UINT64_MAX)
+				cond_.wait(lk);
+			else
+				cond_.wait_until(lk, start_ + tick_ * wakeup_);
+		}
+	}
+
+	void TimerWheel::wake()
+	{
+		if (!strand_)
+		{
+			cond_.notify_one();
+			return;
+		}
+
+		std::weak_ptr<TimerWheel> weak = shared_from_this();
+		boost::asio::post(*strand_, [weak]()
+			{
+				if (auto self = weak.lock())
+					self->arm();
+			});
+	}
+
+	void TimerWheel::onExpire()
+	{
+		std::vector<timer_handler> due;
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			if (stopped_)
+				return;
+
+			uint64_t now = (clock::now() - start_) / tick_;
+			if (now > current_)
+				expire(now, due);
+			wakeup_ = due.empty() ? nextTick() : 0;
+		}
+
+		for (auto& handler : due)
+			handler();
+
+		if (!due.empty())
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			wakeup_ = nextTick();
+		}
+		arm();
+	}
+
+	void TimerWheel::arm()
+	{
+		clock::time_point deadline;
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			if (stopped_ || wakeup_ == UINT64_MAX)
+				return;
+			deadline = start_ + tick_ * wakeup_;
+		}
+
+		std::weak_ptr<TimerWheel> weak = shared_from_this();
+		timer_->expires_at(deadline);
+		timer_->async_wait(boost::asio::bind_executor(*strand_, [weak](const boost::system::error_code& ec)
+			{
+				if (ec)
+					return;
+				if (auto self = weak.lock())
+					self->onExpire();
+			}));
+	}
+
+	uint64_t TimerWheel::tickOf(clock::time_point t) const
+	{
+		auto elapsed = t - start_;
+		return (elapsed + tick_ - clock::duration(1)) / tick_;
+	}
+
+	void TimerWheel::expire(uint64_t now, std::vector<timer_handler>& due)
+	{
+		uint64_t count = std::min<uint64_t>(now - current_, slots_.size());
+		for (uint64_t i = 1; i <= count; ++i)
+		{
+			auto& slot = slots_[(current_ + i) % slots_.size()];
+			for (auto it = slot.begin(); it != slot.end();)
+			{
+				if (it->tick <= now)
+				{
+					due.push_back(std::move(it->handler));
+					entries_.erase(it->id);
+					it = slot.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+		}
+		current_ = now;
+	}
+
+	uint64_t TimerWheel::nextTick() const
+	{
+		if (entries_.empty())
+			return UINT64_MAX;
+
+		for (uint64_t i = 1; i <= slots_.size(); ++i)
+		{
+			if (!slots_[(current_ + i) % slots_.size()].empty())
+				return current_ + i;
+		}
+		return UINT64_MAX;
+	}
+}
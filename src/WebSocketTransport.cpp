@@ -1,4 +1,6 @@
 #include "WebSocketTransport.h"
+#include "Thread.h"
+#include <algorithm>
 #include <iostream>
 #ifdef WIN32
 #define strcasecmp _stricmp
@@ -9,67 +11,455 @@ namespace protoo
 {
 	WebSocketTransport::WebSocketTransport(const std::string& url, void* options)
 		: url_(url)
-		, thread_(std::make_unique<std::thread>(&WebSocketTransport::runWebSocket, this))
+		, own_ioc_(std::make_unique<boost::asio::io_context>())
+		, ioc_(own_ioc_.get())
 	{
 		PROTOO_LOG_TRACE(logger) << " [url:" << url << "]";
+
+		work_ = std::make_unique<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>>(ioc_->get_executor());
+		init();
+		thread_ = std::make_unique<std::thread>([this]() { ioc_->run(); });
+	}
+
+	WebSocketTransport::WebSocketTransport(const std::string& url, void* options, boost::asio::io_context& ioc)
+		: url_(url)
+		, ioc_(&ioc)
+	{
+		PROTOO_LOG_TRACE(logger) << " [url:" << url << "]";
+
+		init();
+	}
+
+	WebSocketTransport::~WebSocketTransport()
+	{
+		close();
+
+		{
+			std::lock_guard<std::recursive_mutex> lk(guard_->mtx);
+			flush(true);
+			guard_->self = nullptr;
+		}
+
+		if (thread_ && thread_->joinable())
+		{
+			work_.reset();
+			ioc_->stop();
+			joinThread(*thread_);
+		}
+		else if (!own_ioc_)
+		{
+			// websocketpp's resolve and connect handlers may still be queued on
+			// the caller's io_context; the connection they hold keeps the
+			// endpoint alive, and our reference goes on the io thread
+			std::shared_ptr<client> endpoint = std::move(endpoint_);
+			boost::asio::post(*ioc_, [endpoint]() {});
+		}
+	}
+
+	void WebSocketTransport::detach()
+	{
+		std::lock_guard<std::recursive_mutex> lk(guard_->mtx);
+		open_handler_ = nullptr;
+		disconnected_handler_ = nullptr;
+		close_handler_ = nullptr;
+		failed_handler_ = nullptr;
+		message_handler_ = nullptr;
+		high_water_handler_ = nullptr;
+		low_water_handler_ = nullptr;
 	}
 
 	void WebSocketTransport::close()
 	{
-		if (closed_)
+		if (closed_.exchange(true))
 			return;
 
-		closed_ = true;
-		if(close_handler_) close_handler_();	
+		wakeWriters();
+		if(close_handler_) close_handler_();
 
-		endpoint_.reset();
+		// queued messages go out ahead of the close frame; if we are destroyed
+		// before this runs, the destructor flushes them instead
+		auto guard = guard_;
+		std::shared_ptr<client> endpoint = endpoint_;
+		boost::asio::post(*ioc_, [guard, endpoint]()
+			{
+				std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+				if (guard->self)
+				{
+					guard->self->flush(true);
+					guard->self->retry_timer_->cancel();
+					guard->self->cork_timer_->cancel();
+				}
+				websocketpp::lib::error_code ec;
+				if (!guard->ws.expired())
+					endpoint->close(guard->ws, websocketpp::close::status::normal, "", ec);
+			});
 	}
 
-	void WebSocketTransport::send(const nlohmann::json& message)
+	void WebSocketTransport::send(const nlohmann::json& message, SendLane lane)
 	{
 		if (closed_)
-			throw std::exception("transport closed");
-		if (ws_.expired())
-			throw std::exception("transport expired");
+			throw std::runtime_error("transport closed");
+		if (!open_)
+			throw std::runtime_error("transport expired");
 
-		endpoint_->send(ws_, message.dump(), websocketpp::frame::opcode::text);
+		chunked_t payload;
+		chunks_->dump(message, payload);
+		enqueue(std::move(payload), lane);
 	}
 
-	void WebSocketTransport::runWebSocket()
+	void WebSocketTransport::send(const nlohmann::json& envelope, boost::string_view data, SendLane lane)
 	{
-		websocketpp::uri uri(url_);
+		if (closed_)
+			throw std::runtime_error("transport closed");
+		if (!open_)
+			throw std::runtime_error("transport expired");
+
+		chunked_t payload;
+		chunks_->dump(envelope, "data", data, payload);
+		enqueue(std::move(payload), lane);
+	}
+
+	void WebSocketTransport::enqueue(chunked_t&& payload, SendLane lane)
+	{
+		size_t size = payload.size;
+		if (size > lanes_.priority_max)
+			lane = SendLane::bulk;
+		buffered(size);
+		queued_bytes_ += size;
+		(lane == SendLane::priority ? priority_lane_ : bulk_lane_).push(std::move(payload));
+
+		bool corked = cork_.window.count() > 0;
+		if (!corked && ioc_->get_executor().running_in_this_thread())
+		{
+			std::lock_guard<std::recursive_mutex> lk(guard_->mtx);
+			flush();
+			return;
+		}
+
+		if (!corked)
+		{
+			// cleared by the flush before it drains, so this push is either seen
+			// by a flush already posted or posts a new one
+			if (!scheduled_.exchange(true))
+				post(&WebSocketTransport::flushQueued);
+			return;
+		}
 
-		auto init = [this, &uri]()
+		if (lane == SendLane::priority || queued_bytes_ >= cork_.bytes)
 		{
-			using websocketpp::lib::placeholders::_1;
-			using websocketpp::lib::placeholders::_2;
-			using websocketpp::lib::bind;
-			if (endpoint_)
+			if (!urgent_.exchange(true))
+				post(&WebSocketTransport::flushQueued);
+		}
+		else if (!scheduled_.exchange(true))
+		{
+			post(&WebSocketTransport::armCork);
+		}
+	}
+
+	std::chrono::microseconds WebSocketTransport::get_cork_window() const
+	{
+		auto window = cork_.window;
+		int64_t srtt = srtt_.load(std::memory_order_relaxed);
+		if (cork_.auto_tune && srtt > 0)
+			window = std::min(window, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(srtt / 8)));
+		return window;
+	}
+
+	void WebSocketTransport::observeRtt(std::chrono::steady_clock::duration rtt)
+	{
+		// smoothed like TCP's SRTT, gain 1/8; racing updates lose a sample at most
+		int64_t sample = std::chrono::duration_cast<std::chrono::nanoseconds>(rtt).count();
+		int64_t srtt = srtt_.load(std::memory_order_relaxed);
+		srtt_.store(srtt ? srtt + (sample - srtt) / 8 : sample, std::memory_order_relaxed);
+	}
+
+	void WebSocketTransport::post(void (WebSocketTransport::*f)())
+	{
+		auto guard = guard_;
+		boost::asio::post(*ioc_, [guard, f]()
 			{
-				endpoint_.reset();
-			}
-			endpoint_ = std::make_unique<client>();
+				std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+				if (guard->self)
+					(guard->self->*f)();
+			});
+	}
+
+	void WebSocketTransport::armCork()
+	{
+		auto guard = guard_;
+		cork_timer_->expires_after(get_cork_window());
+		cork_timer_->async_wait([guard](const boost::system::error_code& ec)
+			{
+				if (ec)
+					return;
+				std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+				if (guard->self)
+					guard->self->flushQueued();
+			});
+	}
+
+	void WebSocketTransport::flushQueued()
+	{
+		scheduled_ = false;
+		urgent_ = false;
+		flush();
+	}
+
+	void WebSocketTransport::flush(bool all)
+	{
+		// Bulk messages are handed to websocketpp, whose send queue is FIFO, only
+		// while less than bulk_window bytes are waiting there, so priority ones
+		// never queue behind more than that. The rest wait in bulk_lane_ and go
+		// as writes complete; every priority_burst priority messages let one
+		// bulk message through regardless. Nothing may go between the fragments
+		// of a message but control frames.
+		chunked_t payload;
+		while (writeFragments(all) && priority_lane_.pop(payload))
+		{
+			queued_bytes_ -= payload.size;
+			write(payload);
+			if (++priority_run_ >= lanes_.priority_burst)
+				writeBulk(true);
+		}
+		while (writeFragments(all) && writeBulk(all))
+			;
+	}
+
+	bool WebSocketTransport::writeBulk(bool force)
+	{
+		if (fragment_ < fragmented_.chunks.size())
+			return false;
+		if (!holding_)
+		{
+			if (!bulk_lane_.pop(held_))
+				return false;
+			holding_ = true;
+		}
+		if (!force && written_ >= lanes_.bulk_window)
+			return false;
 
-			endpoint_->set_access_channels(websocketpp::log::alevel::none);
-			//m_endpoint->set_error_channels(websocketpp::log::elevel::all);
+		holding_ = false;
+		priority_run_ = 0;
+		queued_bytes_ -= held_.size;
+		write(held_);
+		return true;
+	}
 
-			// Initialize ASIO
-			endpoint_->init_asio();
+	void WebSocketTransport::write(chunked_t& payload)
+	{
+		if (payload.chunks.size() > 1)
+		{
+			std::swap(fragmented_, payload);
+			fragment_ = 0;
+			writeFragments(false);
+			return;
+		}
+		writeFrame(payload.chunks[0], websocketpp::frame::opcode::text, true);
+	}
 
-			// Register our handlers
-			endpoint_->set_message_handler(bind(&WebSocketTransport::onMessage, this, _1, _2));
-			endpoint_->set_open_handler(bind(&WebSocketTransport::onOpen, this, _1));
-			endpoint_->set_close_handler(bind(&WebSocketTransport::onClose, this, _1));
-			endpoint_->set_fail_handler(bind(&WebSocketTransport::onFail, this, _1));
-			endpoint_->set_tls_init_handler(bind(&WebSocketTransport::onTlsInit, this, uri.get_host().c_str(), _1));
-		};
+	bool WebSocketTransport::writeFragments(bool all)
+	{
+		// paced like bulk messages so control frames queued by websocketpp
+		// meanwhile are not held up by the whole message
+		auto& chunks = fragmented_.chunks;
+		while (fragment_ < chunks.size())
+		{
+			if (!all && written_ >= lanes_.bulk_window)
+				return false;
+
+			size_t i = fragment_++;
+			writeFrame(chunks[i], i ? websocketpp::frame::opcode::continuation : websocketpp::frame::opcode::text,
+				fragment_ == chunks.size());
+		}
+		return true;
+	}
+
+	void WebSocketTransport::writeFrame(std::string& chunk, websocketpp::frame::opcode::value op, bool fin)
+	{
+		// websocketpp masks the payload into a buffer of its own, so the chunk
+		// is lent to the message and recycled straight after
+		size_t size = chunk.size();
+		websocketpp::lib::error_code ec;
+		written_ += size;
+		client::connection_ptr con = endpoint_->get_con_from_hdl(guard_->ws, ec);
+		if (con)
+		{
+			client::message_ptr msg = con->get_message(op, 0);
+			msg->get_raw_payload().swap(chunk);
+			msg->set_fin(fin);
+			ec = con->send(msg);
+			msg->get_raw_payload().swap(chunk);
+		}
+		chunks_->put(std::move(chunk));
+		if (ec)
+		{
+			PROTOO_LOG_WARN(logger) << " [error:" << ec.message() << "]";
+			written_ -= size;
+			drained(size);
+		}
+	}
+
+	void WebSocketTransport::buffered(size_t size)
+	{
+		size_t amount = buffered_ += size;
+		if (amount < high_ || above_)
+			return;
+		{
+			std::lock_guard<std::mutex> lk(water_mtx_);
+			if (above_ || buffered_ < high_)
+				return;
+			above_ = true;
+		}
+		if (high_water_handler_) high_water_handler_();
+	}
+
+	void WebSocketTransport::drained(size_t size)
+	{
+		size_t amount = buffered_ -= size;
+		if (amount > low_ || !above_)
+			return;
+		{
+			std::lock_guard<std::mutex> lk(water_mtx_);
+			if (!above_ || buffered_ > low_)
+				return;
+			above_ = false;
+		}
+		water_cond_.notify_all();
+		if (low_water_handler_) low_water_handler_();
+	}
+
+	void WebSocketTransport::wakeWriters()
+	{
+		// waiters test closed_ and open_ under the mutex
+		{
+			std::lock_guard<std::mutex> lk(water_mtx_);
+		}
+		water_cond_.notify_all();
+	}
+
+	bool WebSocketTransport::admit(BackpressurePolicy policy)
+	{
+		if (policy == BackpressurePolicy::none || !above_)
+			return true;
+		// the io thread is the one that would drain the buffer
+		if (policy == BackpressurePolicy::fail || ioc_->get_executor().running_in_this_thread())
+			return false;
+
+		std::unique_lock<std::mutex> lk(water_mtx_);
+		water_cond_.wait(lk, [this]() { return !above_ || closed_ || !open_; });
+		return true;
+	}
+
+	void WebSocketTransport::onWritten(size_t size)
+	{
+		written_ -= size;
+		drained(size);
+		if (holding_ || fragment_ < fragmented_.chunks.size())
+			flush();
+	}
+
+	void WebSocketTransport::dropWrites()
+	{
+		// the rest of a fragmented message cannot go on another connection
+		size_t rest = 0;
+		for (; fragment_ < fragmented_.chunks.size(); ++fragment_)
+			rest += fragmented_.chunks[fragment_].size();
+		drained(rest);
+		onWritten(written_);
+		wakeWriters();
+	}
+
+	void WebSocketTransport::init()
+	{
+		using websocketpp::lib::placeholders::_1;
+		using websocketpp::lib::placeholders::_2;
+
+		websocketpp::uri uri(url_);
+		host_ = uri.get_host();
+
+		guard_ = std::make_shared<guard_t>();
+		guard_->self = this;
+		// data is left as text for whoever handles the message
+		parser_.set_raw_member("data");
+		retry_timer_ = std::make_unique<boost::asio::steady_timer>(*ioc_);
+		cork_timer_ = std::make_unique<boost::asio::steady_timer>(*ioc_);
+
+		endpoint_ = std::make_shared<client>();
+		endpoint_->set_access_channels(websocketpp::log::alevel::none);
+		//m_endpoint->set_error_channels(websocketpp::log::elevel::all);
+
+		// Initialize ASIO
+		endpoint_->init_asio(ioc_);
+
+		// Register our handlers
+		auto guard = guard_;
+		endpoint_->set_message_handler([guard](websocketpp::connection_hdl hdl, client::message_ptr msg)
+			{
+				std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+				if (guard->self) guard->self->onMessage(hdl, msg);
+			});
+		endpoint_->set_open_handler([guard](websocketpp::connection_hdl hdl)
+			{
+				std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+				if (guard->self) guard->self->onOpen(hdl);
+			});
+		endpoint_->set_close_handler([guard](websocketpp::connection_hdl hdl)
+			{
+				std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+				if (guard->self) guard->self->onClose(hdl);
+			});
+		endpoint_->set_fail_handler([guard](websocketpp::connection_hdl hdl)
+			{
+				std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+				if (guard->self) guard->self->onFail(hdl);
+			});
+		// messages are coalesced here (see send), so Nagle would only add delay
+		endpoint_->set_tcp_post_init_handler([guard](websocketpp::connection_hdl hdl)
+			{
+				std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+				if (!guard->self)
+					return;
+				websocketpp::lib::error_code ec;
+				client::connection_ptr con = guard->self->endpoint_->get_con_from_hdl(hdl, ec);
+				boost::system::error_code ignored;
+				if (!con)
+					return;
+				con->get_raw_socket().set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+#ifdef TCP_NOTSENT_LOWAT
+				// keep the backlog in our lanes, where priority applies, rather
+				// than in the kernel's send buffer
+				if (guard->self->lanes_.notsent_lowat)
+				{
+					typedef boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_NOTSENT_LOWAT> notsent_lowat;
+					con->get_raw_socket().set_option(notsent_lowat(int(guard->self->lanes_.notsent_lowat)), ignored);
+				}
+#endif
+			});
+		endpoint_->set_tls_init_handler([guard](websocketpp::connection_hdl hdl) -> context_ptr
+			{
+				std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+				if (!guard->self)
+					return nullptr;
+				return guard->self->onTlsInit(guard->self->host_.c_str(), hdl);
+			});
+	}
+
+	void WebSocketTransport::start()
+	{
+		chunks_ = std::make_unique<ChunkPool>(fragment_size_);
+		post(&WebSocketTransport::connect);
+	}
+
+	void WebSocketTransport::connect()
+	{
+		if (closed_)
+			return;
 
 		try
 		{
 			currentAttempt_++;
 			PROTOO_LOG_DEBUG(logger) << "[currentAttempt:" << currentAttempt_ << "]";
 
-			init();
 			websocketpp::lib::error_code ec;
 			client::connection_ptr con = endpoint_->get_connection(url_, ec);
 
@@ -78,11 +468,29 @@ namespace protoo
 				err_ = ec.message();
 				return;
 			}
+			if (batch_mode_ == BatchMode::negotiate)
+				con->add_subprotocol("protoo-batch");
 			con->add_subprotocol("protoo");
+			// the connection's pending handlers and its masking rng belong to
+			// the endpoint, so it must not go before the connection does
+			std::shared_ptr<client> endpoint = endpoint_;
+			con->set_termination_handler([endpoint](client::connection_ptr) {});
+			auto guard = guard_;
+			con->set_write_complete_handler([guard](websocketpp::connection_hdl, size_t size)
+				{
+					std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+					if (guard->self) guard->self->onWritten(size);
+				});
+			if (incremental_)
+			{
+				con->set_payload_handler([guard](const char* data, size_t size)
+					{
+						std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+						if (guard->self) guard->self->parser_.feed(data, size);
+					});
+			}
 
 			endpoint_->connect(con);
-
-			endpoint_->run();
 		}
 		catch (websocketpp::exception& e)
 		{
@@ -94,6 +502,21 @@ namespace protoo
 		}
 	}
 
+	void WebSocketTransport::reconnect()
+	{
+		// 1, 2, 4, 8, 8... seconds
+		auto delay = std::chrono::milliseconds(1000 << std::min<uint32_t>(retries_++, 3));
+		auto guard = guard_;
+		retry_timer_->expires_after(delay);
+		retry_timer_->async_wait([guard](const boost::system::error_code& ec)
+			{
+				if (ec)
+					return;
+				std::lock_guard<std::recursive_mutex> lk(guard->mtx);
+				if (guard->self) guard->self->connect();
+			});
+	}
+
 	void WebSocketTransport::onMessage(websocketpp::connection_hdl hdl, client::message_ptr msg)
 	{
 		if (closed_)
@@ -101,14 +524,24 @@ namespace protoo
 
 		try
 		{
-			auto message = nlohmann::json::parse(msg->get_payload());
+			Message message;
+			if (incremental_)
+			{
+				std::string data;
+				nlohmann::json envelope = parser_.finish(&data);
+				message = Message(std::move(envelope), std::move(data));
+			}
+			else
+			{
+				message = Message(nlohmann::json::parse(msg->get_payload()));
+			}
 
 			if (!message_handler_)
 			{
 				PROTOO_LOG_ERROR(logger) << "no listeners for WebSocket 'message' event, ignoring received message";
 				return;
 			}
-			message_handler_(message);
+			message_handler_(std::move(message));
 		}
 		catch (const std::exception& e)
 		{
@@ -118,13 +551,23 @@ namespace protoo
 
 	void WebSocketTransport::onOpen(websocketpp::connection_hdl hdl)
 	{
-		ws_ = hdl;
+		guard_->ws = hdl;
+		// drop whatever a previous connection left half read
+		parser_.reset();
+		if (batch_mode_ == BatchMode::negotiate)
+			batching_ = endpoint_->get_con_from_hdl(hdl)->get_response_header("Sec-WebSocket-Protocol") == "protoo-batch";
+		else
+			batching_ = batch_mode_ == BatchMode::on;
+		open_ = true;
 		wasConnected_ = true;
+		retries_ = 0;
 		if(open_handler_) open_handler_();
 	}
 
 	void WebSocketTransport::onClose(websocketpp::connection_hdl hdl)
 	{
+		open_ = false;
+		dropWrites();
 		if (closed_)
 			return;
 
@@ -133,6 +576,8 @@ namespace protoo
 
 	void WebSocketTransport::onFail(websocketpp::connection_hdl hdl)
 	{
+		open_ = false;
+		dropWrites();
 		if (closed_)
 			return;
 
@@ -155,8 +600,7 @@ namespace protoo
 				if (closed_)
 					return;
 
-				auto thread = std::make_unique<std::thread>(&WebSocketTransport::runWebSocket, this);
-				std::swap(thread_, thread);
+				reconnect();
 				return;
 			}
 		}
@@ -0,0 +1,119 @@
+#include "WorkStealingPool.h"
+#include "Thread.h"
+
+namespace protoo
+{
+	// the pool and worker the current thread belongs to, if any
+	static thread_local const WorkStealingPool* current_pool = nullptr;
+	static thread_local size_t current_index = 0;
+
+	WorkStealingPool::WorkStealingPool(size_t threads)
+	{
+		if (threads == 0)
+			threads = 1;
+		for (size_t i = 0; i < threads; ++i)
+			workers_.push_back(std::make_unique<worker_t>());
+		for (size_t i = 0; i < threads; ++i)
+			threads_.emplace_back(&WorkStealingPool::run, this, i);
+	}
+
+	WorkStealingPool::~WorkStealingPool()
+	{
+		stop();
+	}
+
+	void WorkStealingPool::post(task t)
+	{
+		if (stopped_)
+			return;
+
+		size_t index = current_pool == this ? current_index : next_++ % workers_.size();
+		{
+			std::lock_guard<std::mutex> lk(workers_[index]->mtx);
+			workers_[index]->tasks.push_back(std::move(t));
+		}
+
+		// pairs with the idle_ increment in run(): either we see the worker
+		// going idle, or it sees the pending task before it waits
+		pending_++;
+		if (idle_ > 0)
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			cond_.notify_one();
+		}
+	}
+
+	void WorkStealingPool::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lk(mtx_);
+			stopped_ = true;
+		}
+		cond_.notify_all();
+
+		for (auto& thread : threads_)
+			joinThread(thread);
+
+		// destroyed outside any lock, tasks may own objects with side effects
+		for (auto& worker : workers_)
+		{
+			std::deque<task> tasks;
+			{
+				std::lock_guard<std::mutex> lk(worker->mtx);
+				std::swap(tasks, worker->tasks);
+			}
+		}
+	}
+
+	void WorkStealingPool::run(size_t index)
+	{
+		current_pool = this;
+		current_index = index;
+
+		task t;
+		while (true)
+		{
+			if (take(index, t))
+			{
+				pending_--;
+				t();
+				t = nullptr;
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lk(mtx_);
+			idle_++;
+			cond_.wait(lk, [this]() { return stopped_ || pending_ > 0; });
+			idle_--;
+			if (stopped_)
+				return;
+		}
+	}
+
+	bool WorkStealingPool::take(size_t index, task& t)
+	{
+		{
+			worker_t& own = *workers_[index];
+			std::lock_guard<std::mutex> lk(own.mtx);
+			if (!own.tasks.empty())
+			{
+				t = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < workers_.size(); ++i)
+		{
+			worker_t& victim = *workers_[(index + i) % workers_.size()];
+			std::lock_guard<std::mutex> lk(victim.mtx);
+			if (!victim.tasks.empty())
+			{
+				t = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+}
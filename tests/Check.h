@@ -0,0 +1,24 @@
+#ifndef CHAI51_TESTS_CHECK
+#define CHAI51_TESTS_CHECK
+
+#include <cstdio>
+
+// Records a failure and keeps going, so one run reports every broken case.
+// A test's main returns check_failures() != 0 as its exit status.
+inline int& check_failures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(expr) \
+	do \
+	{ \
+		if (!(expr)) \
+		{ \
+			++check_failures(); \
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+		} \
+	} while (0)
+
+#endif	// CHAI51_TESTS_CHECK
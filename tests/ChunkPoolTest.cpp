@@ -0,0 +1,207 @@
+// ChunkPool: chunks join up to json::dump and never split a UTF-8
+// sequence, the raw splice, and buffer reuse, also across threads.
+#include "ChunkPool.h"
+
+#include <stdint.h>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+
+using protoo::ChunkPool;
+using protoo::chunked_t;
+using nlohmann::json;
+
+namespace
+{
+	class TestPool : public ChunkPool
+	{
+	public:
+		using ChunkPool::ChunkPool;
+		using ChunkPool::get;
+	};
+
+	std::string join(const chunked_t& out)
+	{
+		std::string text;
+		for (const auto& chunk : out.chunks)
+			text += chunk;
+		return text;
+	}
+
+	// every chunk but the last is full save for a moved UTF-8 tail, and none
+	// starts inside a sequence
+	bool wellFormed(const ChunkPool& pool, const chunked_t& out)
+	{
+		if (out.chunks.empty() || join(out).size() != out.size)
+			return false;
+		for (size_t i = 0; i < out.chunks.size(); ++i)
+		{
+			const std::string& chunk = out.chunks[i];
+			if (chunk.size() > pool.chunk_size())
+				return false;
+			if (i + 1 < out.chunks.size() && chunk.size() + 3 < pool.chunk_size())
+				return false;
+			if (i > 0 && (chunk.empty() || (uint8_t(chunk[0]) & 0xC0) == 0x80))
+				return false;
+		}
+		return true;
+	}
+
+	json message(size_t pad, int repeat)
+	{
+		std::string text(pad, 'x');
+		for (int i = 0; i < repeat; ++i)
+			text += "\xc3\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80\\\"";
+		return { { "request", true }, { "id", 1 }, { "method", "m" }, { "data", { { "text", text } } } };
+	}
+
+	void testChunks()
+	{
+		CHECK(ChunkPool(4).chunk_size() == 16);
+
+		// every alignment of the multi-byte sequences against chunk ends
+		ChunkPool pool(16);
+		for (size_t pad = 0; pad < 20; ++pad)
+		{
+			json m = message(pad, 8);
+			chunked_t out;
+			pool.dump(m, out);
+			CHECK(out.chunks.size() > 1);
+			CHECK(wellFormed(pool, out));
+			CHECK(join(out) == m.dump());
+			for (auto& chunk : out.chunks)
+				pool.put(std::move(chunk));
+		}
+
+		ChunkPool whole(0);
+		chunked_t out;
+		json m = message(3, 100);
+		whole.dump(m, out);
+		CHECK(out.chunks.size() == 1);
+		CHECK(join(out) == m.dump());
+	}
+
+	void testSplice()
+	{
+		ChunkPool pool(16);
+		json m = message(5, 2);
+		json data = m["data"];
+		m.erase("data");
+
+		chunked_t out;
+		std::string raw = data.dump();
+		pool.dump(m, "data", raw, out);
+		CHECK(wellFormed(pool, out));
+		json spliced = json::parse(join(out));
+		CHECK(spliced["data"] == data);
+		spliced.erase("data");
+		CHECK(spliced == m);
+
+		// empty raw leaves the key out
+		pool.dump(m, "data", "", out);
+		CHECK(join(out) == m.dump());
+
+		pool.dump(json::object(), "data", "[1,2]", out);
+		CHECK(join(out) == "{\"data\":[1,2]}");
+
+		bool threw = false;
+		try
+		{
+			pool.dump(json::array(), "data", "1", out);
+		}
+		catch (const std::invalid_argument&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	void testReuse()
+	{
+		TestPool pool(16, 2);
+		std::string a = pool.get();
+		std::string b = pool.get();
+		std::string c = pool.get();
+		const char* pa = a.data();
+		const char* pb = b.data();
+		a = "leftover";
+		pool.put(std::move(a));
+		pool.put(std::move(b));
+		// beyond maxIdle the buffer is not kept
+		pool.put(std::move(c));
+
+		std::string first = pool.get();
+		std::string second = pool.get();
+		std::string fresh = pool.get();
+		CHECK(first.data() == pb && first.empty());
+		CHECK(second.data() == pa && second.empty());
+		CHECK(fresh.data() != c.data());
+		CHECK(fresh.capacity() >= 16);
+
+		// buffers too small or too large to be a chunk are not kept
+		std::string small;
+		std::string large;
+		large.reserve(64);
+		pool.put(std::move(small));
+		pool.put(std::move(large));
+		std::string next = pool.get();
+		CHECK(next.data() != large.data());
+		CHECK(next.capacity() >= 16 && next.capacity() <= 32);
+
+		// a second message is written into the first one's buffers
+		chunked_t out;
+		pool.dump(message(0, 4), out);
+		std::set<const char*> returned;
+		for (auto& chunk : out.chunks)
+		{
+			returned.insert(chunk.data());
+			pool.put(std::move(chunk));
+		}
+		pool.dump(message(0, 4), out);
+		size_t reused = 0;
+		for (auto& chunk : out.chunks)
+			reused += returned.count(chunk.data());
+		CHECK(reused >= 2);
+	}
+
+	void testThreads()
+	{
+		const int threads = 4;
+		ChunkPool pool(32, 8);
+		std::vector<std::thread> workers;
+		std::vector<int> failures(threads, 0);
+		for (int t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&, t]() {
+				chunked_t out;
+				for (int i = 0; i < 2000; ++i)
+				{
+					json m = message(size_t(t + i) % 40, 1 + i % 9);
+					pool.dump(m, out);
+					if (!wellFormed(pool, out) || join(out) != m.dump())
+						++failures[t];
+					for (auto& chunk : out.chunks)
+						pool.put(std::move(chunk));
+				}
+			});
+		}
+		for (auto& worker : workers)
+			worker.join();
+
+		for (int failed : failures)
+			CHECK(failed == 0);
+	}
+}
+
+int main()
+{
+	testChunks();
+	testSplice();
+	testReuse();
+	testThreads();
+	return check_failures() != 0;
+}
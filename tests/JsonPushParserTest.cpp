@@ -0,0 +1,204 @@
+// Differential test of JsonPushParser against nlohmann::json::parse: every
+// input is fed whole, a byte at a time, split at every offset and in random
+// pieces, and must give the same value or the same failure.
+#include "JsonPushParser.h"
+
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+
+using protoo::JsonPushParser;
+using nlohmann::json;
+
+namespace
+{
+	JsonPushParser plain;
+	JsonPushParser withRaw;
+
+	// pieces[i] is the size of the i-th feed(); the rest goes in one piece
+	bool parse(JsonPushParser& parser, const std::string& text, const std::vector<size_t>& pieces,
+		json& value, std::string* raw)
+	{
+		size_t offset = 0;
+		for (size_t size : pieces)
+		{
+			size = std::min(size, text.size() - offset);
+			parser.feed(text.data() + offset, size);
+			offset += size;
+		}
+		parser.feed(text.data() + offset, text.size() - offset);
+		try
+		{
+			value = parser.finish(raw);
+			return true;
+		}
+		catch (const std::invalid_argument&)
+		{
+			return false;
+		}
+	}
+
+	void report(const std::string& text, const std::vector<size_t>& pieces, const char* what)
+	{
+		std::string cuts;
+		for (size_t size : pieces)
+			cuts += std::to_string(size) + " ";
+		std::fprintf(stderr, "  %s: [%s] fed as [%s]\n", what, text.c_str(), cuts.c_str());
+	}
+
+	void check(const std::string& text, const std::vector<size_t>& pieces)
+	{
+		json expected;
+		bool ok = true;
+		try
+		{
+			expected = json::parse(text);
+		}
+		catch (const json::exception&)
+		{
+			ok = false;
+		}
+
+		json value;
+		bool same = parse(plain, text, pieces, value, nullptr) == ok;
+		// == treats 1 and 1.0 alike, dump() does not
+		if (same && ok)
+			same = value == expected && value.dump() == expected.dump();
+		CHECK(same);
+		if (!same)
+			report(text, pieces, "value");
+
+		// an envelope is only valid if the whole message is, the raw member
+		// is only checked for balanced brackets
+		if (!ok || !expected.is_object())
+			return;
+
+		std::string raw;
+		bool hasData = expected.contains("data");
+		json data;
+		if (hasData)
+		{
+			data = expected["data"];
+			expected.erase("data");
+		}
+		same = parse(withRaw, text, pieces, value, &raw) && value == expected;
+		if (same)
+			same = hasData ? !raw.empty() && json::parse(raw) == data : raw.empty();
+		CHECK(same);
+		if (!same)
+			report(text, pieces, "raw");
+	}
+
+	void checkEverySplit(const std::string& text)
+	{
+		check(text, {});
+		check(text, std::vector<size_t>(text.size(), 1));
+		for (size_t at = 1; at < text.size(); ++at)
+			check(text, { at });
+	}
+
+	void checkRandomSplits(const std::string& text, std::mt19937& rng)
+	{
+		std::vector<size_t> pieces;
+		for (size_t offset = 0; offset < text.size();)
+		{
+			pieces.push_back(1 + rng() % 7);
+			offset += pieces.back();
+		}
+		check(text, pieces);
+	}
+
+	json generate(std::mt19937& rng, int depth)
+	{
+		static const char* const pieces[] = { "\"", "\\", "\xe4\xbd\xa0", "\xf0\x9f\x98\x80", "\n", "\x01", "a", "\xc3\xa9" };
+		switch (depth > 4 ? rng() % 5 : rng() % 8)
+		{
+		case 0:
+			return nullptr;
+		case 1:
+			return rng() % 2 == 0;
+		case 2:
+			return int64_t(rng()) - (int64_t(1) << 31);
+		case 3:
+			return double(rng()) / 7.0;
+		case 4:
+		{
+			std::string s;
+			for (size_t i = rng() % 10; i > 0; --i)
+				s += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+			return s;
+		}
+		case 5:
+		case 6:
+		{
+			json array = json::array();
+			for (size_t i = rng() % 5; i > 0; --i)
+				array.push_back(generate(rng, depth + 1));
+			return array;
+		}
+		default:
+		{
+			json object = json::object();
+			for (size_t i = rng() % 5; i > 0; --i)
+				object[rng() % 3 == 0 ? std::string("data") : std::to_string(rng() % 10)] = generate(rng, depth + 1);
+			return object;
+		}
+		}
+	}
+}
+
+int main()
+{
+	withRaw.set_raw_member("data");
+
+	const std::vector<std::string> cases = {
+		// structure and literals
+		"", "  ", "null ", "true", "tru", "nul", "[true,false,null]", "[tRue]",
+		"[]", "[ ]", "[1,]", "[,1]", "[1 2]", "{}", "{ }", "{\"a\":1,}", "{\"a\" 1}", "{\"a\":1}x",
+		"{\"a\":1,\"a\":2}", "[[[[]]],{\"x\":[{}]}]", "  {\"k\" : [ 1 , 2 ] }  ",
+		// numbers
+		"1", "-0", "01", "1.", "-", "--1", "1e", "0.e1", "1.5e3", "-1e-2", "1E+2", "-12.5e+03",
+		"18446744073709551615", "18446744073709551616", "-9223372036854775808", "-9223372036854775809",
+		// overflow fails, underflow rounds to zero
+		"1e400", "-1e400", "1E999", "1.5e308", "[0,1e400]", "{\"x\":-1E999}", "1e-400", "-1e-400", "1e308",
+		// escapes
+		"\"\\/\\b\\f\\n\\r\\t\\\"\\\\\"", "\"a\\qb\"", "\"tab\there\"", "\"\\u0041\\u00e9\\u4f60\"",
+		"\"\\u00E9\"", "\"\\u00g9\"", "\"\\u00\"", "\"\\u0000\"",
+		// surrogate pairs, lone and mismatched halves
+		"\"\\ud83d\\ude00\"", "\"x\\uD83D\\uDE00y\"", "\"\\ud83d\"", "\"\\ude00\"", "\"\\ud83dx\"",
+		"\"\\ud83d\\u0041\"", "\"\\ud83d\\ud83d\"",
+		// multi-byte UTF-8, 2 to 4 bytes, in values and keys
+		"\"\xc3\xa9\"", "\"\xe4\xbd\xa0\xe5\xa5\xbd\"", "\"\xf0\x9f\x98\x80\"",
+		"{\"\xe9\x94\xae\":\"\xf0\x9f\x98\x80\\n\xc3\xa9\"}",
+		"{\"a\":[1,{\"b\":null}],\"c\":\"\xe4\xbd\xa0\"}",
+		// the raw member: brackets and escaped quotes inside its strings,
+		// nested data members, and data at either end
+		"{\"data\" : \"a,}\\\"]\" , \"x\":1}", "{\"data\":[1,{\"a\":\"]\"}] }", "{\"data\":\"\\\\\"}",
+		"{\"data\":{\"s\":\"\\\"}{\\\\\",\"t\":\"\xf0\x9f\x98\x80\"}}", "{\"id\":1,\"data\":{\"k\":[]}}",
+		"{\"x\":{\"data\":1},\"data\":null}", "{\"data\":-1.5e3}", "{\"data\":true}",
+		"{\"data\":}", "{\"data\": 1 2}", "{\"data\":[1,2}",
+		"{\"request\":true,\"id\":12,\"method\":\"m\",\"data\":{\"text\":\"\xe4\xbd\xa0 \\u4f60 \\ud83d\\ude00\"}}"
+	};
+	for (const auto& text : cases)
+		checkEverySplit(text);
+
+	std::mt19937 rng(1);
+	for (int i = 0; i < 20000; ++i)
+	{
+		std::string text = generate(rng, 0).dump();
+		checkRandomSplits(text, rng);
+
+		// break the document in an ASCII position, keeping UTF-8 intact
+		size_t at = rng() % text.size();
+		if (i % 4 == 0 && (unsigned char)text[at] < 0x80)
+		{
+			text[at] = "{}[],:\"x1 \\"[rng() % 11];
+			checkRandomSplits(text, rng);
+		}
+	}
+
+	return check_failures() != 0;
+}
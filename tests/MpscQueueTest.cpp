@@ -0,0 +1,82 @@
+// MpscQueue: empty pops, and per-producer order with several producers.
+#include "MpscQueue.h"
+
+#include <stdint.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+
+using protoo::MpscQueue;
+
+namespace
+{
+	void testEmpty()
+	{
+		MpscQueue<int> queue;
+		int value = -1;
+		CHECK(!queue.pop(value));
+		queue.push(1);
+		queue.push(2);
+		CHECK(queue.pop(value) && value == 1);
+		CHECK(queue.pop(value) && value == 2);
+		CHECK(!queue.pop(value));
+		CHECK(value == 2);
+
+		// elements left behind are freed with the queue
+		MpscQueue<std::shared_ptr<int>> owning;
+		auto element = std::make_shared<int>(0);
+		owning.push(element);
+		{
+			MpscQueue<std::shared_ptr<int>> dropped;
+			dropped.push(element);
+			CHECK(element.use_count() == 3);
+		}
+		CHECK(element.use_count() == 2);
+	}
+
+	void testProducers()
+	{
+		const int producers = 4;
+		const int count = 100000;
+		MpscQueue<uint64_t> queue;
+		std::vector<std::thread> threads;
+		for (int p = 0; p < producers; ++p)
+		{
+			threads.emplace_back([&, p]() {
+				for (uint64_t n = 0; n < count; ++n)
+					queue.push(uint64_t(p) << 32 | n);
+			});
+		}
+
+		std::vector<uint64_t> next(producers, 0);
+		int received = 0;
+		int misordered = 0;
+		uint64_t value;
+		while (received < producers * count)
+		{
+			if (!queue.pop(value))
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			uint64_t& expected = next[value >> 32];
+			misordered += (value & 0xffffffff) != expected;
+			expected = (value & 0xffffffff) + 1;
+			++received;
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		CHECK(misordered == 0);
+		CHECK(!queue.pop(value));
+	}
+}
+
+int main()
+{
+	testEmpty();
+	testProducers();
+	return check_failures() != 0;
+}
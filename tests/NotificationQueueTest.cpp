@@ -0,0 +1,241 @@
+// NotificationQueue at empty and full under each overflow policy, and
+// per-producer order with several producers.
+#include "NotificationQueue.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+
+using namespace protoo;
+using nlohmann::json;
+
+namespace
+{
+	json message(int n, const std::string& method = "m", int key = 0)
+	{
+		return { { "notification", true }, { "method", method }, { "data", { { "n", n }, { "key", key } } } };
+	}
+
+	int numberOf(const json& message)
+	{
+		return message["data"]["n"].get<int>();
+	}
+
+	// polls everything left, in order
+	std::vector<int> drain(NotificationQueue& queue)
+	{
+		std::vector<int> numbers;
+		json m;
+		while (queue.poll(m))
+			numbers.push_back(numberOf(m));
+		return numbers;
+	}
+
+	std::vector<int> range(int from, int to)
+	{
+		std::vector<int> numbers;
+		for (int n = from; n < to; ++n)
+			numbers.push_back(n);
+		return numbers;
+	}
+
+	void testEmpty()
+	{
+		CHECK(NotificationQueue(0).capacity() == 2);
+		CHECK(NotificationQueue(5).capacity() == 8);
+		CHECK(NotificationQueue(8).capacity() == 8);
+
+		NotificationQueue queue(4);
+		json m;
+		CHECK(!queue.poll(m));
+		CHECK(queue.size() == 0);
+		CHECK(queue.push(message(1)));
+		CHECK(queue.poll(m) && numberOf(m) == 1);
+		CHECK(!queue.poll(m));
+		CHECK(queue.size() == 0);
+	}
+
+	void testDropNewest()
+	{
+		NotificationQueue queue(4, OverflowPolicy::drop_newest);
+		for (int n = 0; n < 6; ++n)
+			queue.push(message(n));
+		CHECK(queue.size() == 4);
+		CHECK(queue.stats().dropped == 2);
+		CHECK(drain(queue) == range(0, 4));
+	}
+
+	void testDropOldest()
+	{
+		NotificationQueue queue(4, OverflowPolicy::drop_oldest);
+		for (int n = 0; n < 6; ++n)
+			queue.push(message(n));
+		CHECK(queue.size() == 4);
+		CHECK(queue.stats().dropped == 2);
+		CHECK(drain(queue) == range(2, 6));
+	}
+
+	void testGrow()
+	{
+		NotificationQueue queue(4);
+		for (int n = 0; n < 100; ++n)
+			queue.push(message(n));
+		CHECK(queue.size() == 100);
+		CHECK(queue.stats().high_water == 100);
+		CHECK(queue.stats().dropped == 0);
+		CHECK(drain(queue) == range(0, 100));
+
+		// the ring frees up while messages are still spilled; new ones must
+		// still queue behind them
+		std::vector<int> numbers;
+		int next = 0;
+		json m;
+		for (int round = 0; round < 50; ++round)
+		{
+			for (int i = 0; i < 7; ++i)
+				queue.push(message(next++));
+			for (int i = 0; i < 5 && queue.poll(m); ++i)
+				numbers.push_back(numberOf(m));
+		}
+		for (int n : drain(queue))
+			numbers.push_back(n);
+		CHECK(numbers == range(0, next));
+	}
+
+	void testBlock()
+	{
+		// an executor-driven consumer makes room from the full handler
+		NotificationQueue inline_(2, OverflowPolicy::block);
+		std::vector<int> numbers;
+		inline_.set_full_handler([&]() {
+			json m;
+			if (inline_.poll(m))
+				numbers.push_back(numberOf(m));
+		});
+		for (int n = 0; n < 10; ++n)
+			inline_.push(message(n));
+		for (int n : drain(inline_))
+			numbers.push_back(n);
+		CHECK(numbers == range(0, 10));
+
+		// a producer thread waits for the consumer
+		NotificationQueue queue(2, OverflowPolicy::block);
+		std::thread producer([&]() {
+			for (int n = 0; n < 10000; ++n)
+				queue.push(message(n));
+		});
+		numbers.clear();
+		json m;
+		while (numbers.size() < 10000 && queue.pop(m))
+			numbers.push_back(numberOf(m));
+		producer.join();
+		CHECK(numbers == range(0, 10000));
+		CHECK(queue.stats().high_water <= 2);
+	}
+
+	void testCoalesce()
+	{
+		// coalesce_by_key only merges when the ring is full
+		NotificationQueue queue(2, OverflowPolicy::coalesce_by_key, [](const json& m) {
+			return std::to_string(m["data"]["key"].get<int>());
+		});
+		queue.push(message(0, "m", 1));
+		queue.push(message(1, "m", 2));
+		queue.push(message(2, "m", 1));
+		queue.push(message(3, "m", 3));
+		CHECK(queue.stats().coalesced == 1);
+		CHECK(queue.stats().dropped == 1);
+		CHECK(drain(queue) == std::vector<int>({ 2, 1 }));
+
+		// registered methods always keep only the newest per key
+		coalesce_registry registry;
+		registry["volume"] = [](const json& m) { return std::to_string(m["data"]["key"].get<int>()); };
+		registry["ping"] = nullptr;
+		NotificationQueue registered(4, OverflowPolicy::grow, nullptr, registry);
+		registered.push(message(0, "volume", 1));
+		registered.push(message(1, "volume", 2));
+		registered.push(message(2, "other"));
+		registered.push(message(3, "volume", 1));
+		registered.push(message(4, "ping"));
+		registered.push(message(5, "ping"));
+		CHECK(registered.stats().coalesced == 2);
+		CHECK(drain(registered) == std::vector<int>({ 3, 1, 2, 5 }));
+
+		// once taken, the next message with that key queues again
+		registered.push(message(6, "volume", 1));
+		CHECK(drain(registered) == std::vector<int>({ 6 }));
+	}
+
+	void testClose()
+	{
+		NotificationQueue queue(4);
+		std::thread consumer([&]() {
+			json m;
+			CHECK(!queue.pop(m));
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		queue.close();
+		consumer.join();
+		CHECK(!queue.push(message(0)));
+
+		// a producer blocked on a full ring gives up
+		NotificationQueue full(2, OverflowPolicy::block);
+		full.push(message(0));
+		full.push(message(1));
+		std::thread producer([&]() { full.push(message(2)); });
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		full.close();
+		producer.join();
+		CHECK(full.size() == 2);
+	}
+
+	void testProducers(OverflowPolicy policy)
+	{
+		const int producers = 4;
+		const int count = 20000;
+		NotificationQueue queue(64, policy);
+		std::vector<std::thread> threads;
+		for (int p = 0; p < producers; ++p)
+		{
+			threads.emplace_back([&, p]() {
+				for (int n = 0; n < count; ++n)
+					queue.push(message(n, "m", p));
+			});
+		}
+
+		std::vector<int> next(producers, 0);
+		int received = 0;
+		int misordered = 0;
+		json m;
+		while (received < producers * count && queue.pop(m))
+		{
+			int& expected = next[m["data"]["key"].get<int>()];
+			misordered += numberOf(m) != expected;
+			expected = numberOf(m) + 1;
+			++received;
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		CHECK(received == producers * count);
+		CHECK(misordered == 0);
+		CHECK(queue.size() == 0);
+	}
+}
+
+int main()
+{
+	testEmpty();
+	testDropNewest();
+	testDropOldest();
+	testGrow();
+	testBlock();
+	testCoalesce();
+	testClose();
+	testProducers(OverflowPolicy::grow);
+	testProducers(OverflowPolicy::block);
+	return check_failures() != 0;
+}
@@ -0,0 +1,75 @@
+#include "Peer.h"
+#include "StandInServer.h"
+#include "Check.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace protoo;
+
+namespace
+{
+	std::string url;
+
+	template<typename T>
+	bool arrives(std::future<T>& future)
+	{
+		return future.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+	}
+
+	// The first result's handler closes the peer, which fails the requests
+	// still in flight from inside the handler.
+	void testCloseFromHandler(bool ordered)
+	{
+		Peer peer(std::unique_ptr<WebSocketTransport>(new WebSocketTransport(url, nullptr)));
+		std::promise<void> opened;
+		peer.set_open_handler([&]() { opened.set_value(); });
+		auto open = opened.get_future();
+		CHECK(arrives(open));
+
+		std::vector<std::pair<std::string, json>> requests;
+		for (int i = 0; i < 10; ++i)
+			requests.emplace_back("echo", json{ { "i", i } });
+
+		std::atomic<int> calls{ 0 };
+		std::atomic<int> failed{ 0 };
+		auto finished = peer.requestPipeline(requests, 10, ordered, [&](size_t, const json&, std::exception_ptr error) {
+			if (error)
+				++failed;
+			if (calls++ == 0)
+				peer.close();
+		});
+		if (!arrives(finished))
+		{
+			// deadlocked: nothing can be torn down, so report and leave
+			std::fprintf(stderr, "pipeline (%s) never finished\n", ordered ? "ordered" : "unordered");
+			std::_Exit(1);
+		}
+		CHECK(calls == 10);
+		CHECK(failed > 0);
+	}
+}
+
+int main()
+{
+	// the transport logs every connection to std::cout
+	std::cout.setstate(std::ios::failbit);
+
+	StandInServer server;
+	uint16_t port = server.listen(0);
+	CHECK(port != 0);
+	server.start();
+	url = "wss://localhost:" + std::to_string(port) + "/";
+
+	testCloseFromHandler(false);
+	testCloseFromHandler(true);
+	return check_failures() != 0;
+}
@@ -0,0 +1,177 @@
+// SlotTable: stale ids never match a reused slot, the table fills up at
+// 65536 entries, and every id is taken exactly once under contention.
+#include "SlotTable.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+
+using protoo::SlotTable;
+
+namespace
+{
+	const int kThreads = 4;
+
+	void testReuse()
+	{
+		SlotTable<int> table;
+		int value = 0;
+		CHECK(!table.take(0, value));
+		CHECK(!table.take(-1, value));
+		// index 0 with generation 0 was never handed out
+		CHECK(!table.take(1, value));
+
+		int first = table.emplace([](int, int& v) { v = 1; });
+		CHECK(first > 0);
+		CHECK(table.size() == 1);
+		CHECK(table.take(first, value) && value == 1);
+		CHECK(!table.take(first, value));
+		CHECK(table.size() == 0);
+
+		// the free list is LIFO, so this reuses the slot under a new generation
+		int second = table.emplace([](int, int& v) { v = 2; });
+		CHECK(second != first);
+		CHECK((second & 0xffff) == (first & 0xffff));
+		CHECK(!table.take(first, value));
+		CHECK(table.take(second, value) && value == 2);
+
+		// the generation wraps without ever giving id 0 or a repeat in a row
+		int last = second;
+		for (int i = 0; i < 0x10000; ++i)
+		{
+			int id = table.emplace([](int, int& v) { v = 3; });
+			CHECK(id > 0 && id != last);
+			CHECK(table.take(id, value));
+			last = id;
+		}
+	}
+
+	void testFull()
+	{
+		SlotTable<int> table;
+		std::vector<int> ids;
+		while (true)
+		{
+			int id = table.emplace([](int slotId, int& v) { v = slotId; });
+			if (!id)
+				break;
+			ids.push_back(id);
+		}
+		CHECK(ids.size() == 0x10000);
+		CHECK(table.size() == ids.size());
+
+		int value = 0;
+		CHECK(table.take(ids[100], value) && value == ids[100]);
+		int id = table.emplace([](int slotId, int& v) { v = slotId; });
+		CHECK(id && id != ids[100]);
+		CHECK(!table.emplace([](int, int&) {}));
+
+		size_t drained = 0;
+		bool match = true;
+		table.drain([&](int id, int& v) {
+			match = match && v == id;
+			++drained;
+		});
+		CHECK(match);
+		CHECK(drained == ids.size());
+		CHECK(table.size() == 0);
+	}
+
+	// Each thread takes its own entries and then retries every id it has
+	// already taken, which other threads' entries may reuse by now.
+	void testChurn()
+	{
+		SlotTable<int> table;
+		std::atomic<int> failures{ 0 };
+		std::vector<std::thread> threads;
+		for (int t = 0; t < kThreads; ++t)
+		{
+			threads.emplace_back([&, t]() {
+				std::vector<int> ids;
+				std::vector<int> stale;
+				for (int i = 0; i < 100000; ++i)
+				{
+					int id = table.emplace([&](int, int& v) { v = t * 1000000 + i; });
+					if (!id)
+					{
+						++failures;
+						continue;
+					}
+					ids.push_back(id);
+					if (ids.size() < 64)
+						continue;
+
+					for (int id : ids)
+					{
+						int value = -1;
+						if (!table.take(id, value) || value / 1000000 != t)
+							++failures;
+					}
+					for (int id : stale)
+					{
+						int value = -1;
+						if (table.take(id, value))
+							++failures;
+					}
+					stale.swap(ids);
+					ids.clear();
+				}
+				for (int id : ids)
+				{
+					int value = -1;
+					if (!table.take(id, value))
+						++failures;
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		CHECK(failures == 0);
+		CHECK(table.size() == 0);
+	}
+
+	// Every thread races to take every id; each must be won exactly once.
+	void testRace()
+	{
+		const int count = 20000;
+		SlotTable<int> table;
+		std::vector<int> ids;
+		for (int i = 0; i < count; ++i)
+			ids.push_back(table.emplace([i](int, int& v) { v = i; }));
+
+		std::vector<std::atomic<int>> wins(count);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < kThreads; ++t)
+		{
+			threads.emplace_back([&, t]() {
+				for (int i = 0; i < count; ++i)
+				{
+					int at = (i + t * count / kThreads) % count;
+					int value = -1;
+					if (table.take(ids[at], value))
+						wins[value].fetch_add(1);
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		int wrong = 0;
+		for (auto& win : wins)
+			wrong += win != 1;
+		CHECK(wrong == 0);
+		CHECK(table.size() == 0);
+	}
+}
+
+int main()
+{
+	testReuse();
+	testFull();
+	testChurn();
+	testRace();
+	return check_failures() != 0;
+}
@@ -0,0 +1,47 @@
+// Watermark handlers set on the transport and on the Peer both run.
+#include "Peer.h"
+#include "StandInServer.h"
+#include "Check.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace protoo;
+
+int main()
+{
+	// the transport logs every connection to std::cout
+	std::cout.setstate(std::ios::failbit);
+
+	StandInServer server;
+	uint16_t port = server.listen(0);
+	CHECK(port != 0);
+	server.start();
+
+	std::atomic<int> transportHigh{ 0 }, transportLow{ 0 }, peerHigh{ 0 }, peerLow{ 0 };
+	std::unique_ptr<WebSocketTransport> transport(
+		new WebSocketTransport("wss://localhost:" + std::to_string(port) + "/", nullptr));
+	// every message crosses high, and low once written
+	transport->set_watermarks(1, 0);
+	transport->set_high_water_handler([&]() { ++transportHigh; });
+	transport->set_low_water_handler([&]() { ++transportLow; });
+
+	Peer peer(std::move(transport));
+	peer.set_high_water_handler([&]() { CHECK(transportHigh > peerHigh); ++peerHigh; });
+	peer.set_low_water_handler([&]() { CHECK(transportLow > peerLow); ++peerLow; });
+	std::promise<void> opened;
+	peer.set_open_handler([&]() { opened.set_value(); });
+	CHECK(opened.get_future().wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+
+	peer.request("echo", { { "x", 1 } });
+	for (int i = 0; i < 1000 && peerLow == 0; ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	CHECK(transportHigh > 0 && transportHigh == peerHigh);
+	CHECK(transportLow > 0 && transportLow == peerLow);
+	return check_failures() != 0;
+}